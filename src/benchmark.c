@@ -24,7 +24,9 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "engine.h"
 #include "misc.h"
+#include "movegen.h"
 #include "position.h"
 #include "search.h"
 #include "settings.h"
@@ -86,8 +88,36 @@ static char *Defaults[] = {
 // format (defaults are the positions defined above) and the type of the
 // limit value: depth (default), time in millisecs or number of nodes.
 
+// read_fens() reads the positions of a file with one FEN string per line.
+
+static char **read_fens(const char *fenFile, size_t *num_fens)
+{
+  size_t max_fens = 100;
+  *num_fens = 0;
+  FILE *F = fopen(fenFile, "r");
+  if (!F) {
+    fprintf(stderr, "Unable to open file %s\n", fenFile);
+    return NULL;
+  }
+  char **fens = malloc(max_fens * sizeof(char *));
+  fens[0] = NULL;
+  size_t length = 0;
+  while (getline(&fens[*num_fens], &length, F) > 0) {
+    (*num_fens)++;
+    if (*num_fens == max_fens) {
+      max_fens += 100;
+      fens = realloc(fens, max_fens * sizeof(char *));
+    }
+    fens[*num_fens] = NULL;
+    length = 0;
+  }
+  fclose(F);
+  return fens;
+}
+
 void benchmark(Pos *current, char *str)
 {
+  Engine *engine = current->engine;
   char *token;
   char **fens;
   size_t num_fens;
@@ -122,7 +152,7 @@ void benchmark(Pos *current, char *str)
   delayed_settings.tt_size = ttSize;
   delayed_settings.num_threads = threads;
   process_delayed_settings();
-  search_clear();
+  search_clear(engine);
 
   if (strcmp(limitType, "time") == 0)
     limits.movetime = limit; // movetime is in millisecs
@@ -143,31 +173,16 @@ void benchmark(Pos *current, char *str)
     pos_fen(current, fens[0]);
     num_fens = 1;
   }
-  else {
-    size_t max_fens = 100;
-    num_fens = 0;
-    FILE *F = fopen(fenFile, "r");
-    if (!F) {
-      fprintf(stderr, "Unable to open file %s\n", fenFile);
-      return;
-    }
-    fens = malloc(max_fens * sizeof(char *));
-    fens[0] = NULL;
-    size_t length = 0;
-    while (getline(&fens[num_fens], &length, F) > 0) {
-      num_fens++;
-      if (num_fens == max_fens) {
-        max_fens += 100;
-        fens = realloc(fens, max_fens * sizeof(char *));
-      }
-      fens[num_fens] = NULL;
-      length = 0;
-    }
-    fclose(F);
-  }
+  else if (!(fens = read_fens(fenFile, &num_fens)))
+    return;
 
   uint64_t nodes = 0;
+  engine->stopLatency.total = engine->stopLatency.max = engine->stopLatency.count = 0;
+  engine->latency.goTotal = engine->latency.goMax = 0;
+  engine->latency.stopTotal = engine->latency.stopMax = 0;
+  engine->latency.goCount = engine->latency.stopCount = 0;
   Pos pos;
+  pos.engine = engine;
   pos.stack = malloc(101 * sizeof(Stack)); // max perft 100
   pos.stack++;
   pos.moveList = malloc(10000 * sizeof(ExtMove));
@@ -183,9 +198,9 @@ void benchmark(Pos *current, char *str)
       nodes += perft(&pos, limits.depth * ONE_PLY);
     else {
       limits.startTime = now();
-      threads_start_thinking(&pos, &limits);
-      thread_wait_for_search_finished(threads_main());
-      nodes += threads_nodes_searched();
+      threads_start_thinking(engine, &pos, &limits);
+      thread_wait_for_search_finished(threads_main(engine));
+      nodes += threads_nodes_searched(engine);
     }
   }
 
@@ -199,6 +214,13 @@ void benchmark(Pos *current, char *str)
                   "\nNodes/second    : %" PRIu64 "\n",
                   elapsed, nodes, 1000 * nodes / elapsed);
 
+  search_print_latency(engine, stderr);
+
+  tt_print_stats(engine, stderr);
+
+  if (settings.large_pages)
+    tt_print_large_pages(&engine->tt);
+
   if (fens != Defaults) {
     for (size_t i = 0; i < num_fens; i++)
       free(fens[i]);
@@ -208,3 +230,384 @@ void benchmark(Pos *current, char *str)
   free(pos.moveList);
 }
 
+
+
+// analyse() searches the positions of a file, one FEN string per line, to
+// a fixed depth. Unlike benchmark(), which lets all threads search each
+// position together, every thread takes the next position from the file
+// and searches it on its own, sharing only the transposition table. The
+// result for each position is printed as soon as its search finishes:
+//
+//   analyse <file> [threads N] [depth D]
+
+static char **aFens;
+static size_t aNumFens;
+static atomic_size_t aNext;
+static atomic_uint_fast64_t aNodes;
+
+static void analyse_worker(Pos *pos)
+{
+  char buf[16];
+  size_t i;
+
+  while ((i = atomic_fetch_add(&aNext, 1)) < aNumFens) {
+    if (strlen(aFens[i]) < 8) // Skip empty lines
+      continue;
+
+    // pos_set() writes only into pos, castling tables included, so the
+    // workers can set up their positions at the same time.
+    pos_set(pos, aFens[i], option_value(OPT_CHESS960));
+
+    ExtMove list[MAX_MOVES];
+    ExtMove *end = generate_legal(pos, list);
+    RootMoves *rm = pos->rootMoves;
+    rm->size = 0;
+    for (ExtMove *m = list; m < end; m++)
+      root_moves_add(rm, m->move);
+    pos->maxPly = 0;
+    pos->rootDepth = DEPTH_ZERO;
+    pos->nodes = pos->tb_hits = 0;
+
+    if (rm->size)
+      thread_search(pos);
+    atomic_fetch_add(&aNodes, pos->nodes);
+
+    IO_LOCK;
+    printf("analysis %" FMT_Z "u depth %d score %s nodes %" PRIu64 " bestmove ",
+           i + 1, pos->completedDepth / ONE_PLY,
+           uci_value(buf, !rm->size ? (pos_checkers() ? -VALUE_MATE : VALUE_DRAW)
+                                    : rm->move[0].score),
+           pos->nodes);
+    if (!rm->size)
+      printf("(none)");
+    else {
+      printf("%s pv", uci_move(buf, rm->move[0].pv[0], is_chess960()));
+      for (size_t j = 0; j < rm->move[0].pv_size; j++)
+        printf(" %s", uci_move(buf, rm->move[0].pv[j], is_chess960()));
+    }
+    printf("\n");
+    fflush(stdout);
+    IO_UNLOCK;
+  }
+}
+
+void analyse(Pos *current, char *str)
+{
+  Engine *engine = current->engine;
+
+  size_t threads = settings.num_threads;
+  int depth = 13;
+
+  char *fenFile = strtok(str, " ");
+  if (!fenFile) {
+    fprintf(stderr, "Usage: analyse <file> [threads N] [depth D]\n");
+    return;
+  }
+  char *token;
+  while ((token = strtok(NULL, " "))) {
+    char *value = strtok(NULL, " ");
+    if (!value)
+      break;
+    if (strcmp(token, "threads") == 0)
+      threads = atoi(value);
+    else if (strcmp(token, "depth") == 0)
+      depth = atoi(value);
+  }
+
+  if (!(aFens = read_fens(fenFile, &aNumFens)))
+    return;
+
+  if (engine->signals.searching)
+    thread_wait_for_search_finished(threads_main(engine));
+
+  delayed_settings.num_threads = max(threads, 1);
+  process_delayed_settings();
+
+  memset(&engine->limits, 0, sizeof(engine->limits));
+  engine->limits.depth = depth;
+  engine->limits.startTime = now();
+  engine->signals.stop = engine->signals.stopOnPonderhit = 0;
+
+  // Positions with either side to move are searched at the same time, so
+  // draws are scored without contempt.
+  engine->drawValue[WHITE] = engine->drawValue[BLACK] = VALUE_DRAW;
+
+  tt_new_search(&engine->tt);
+  atomic_store(&aNext, 0);
+  atomic_store(&aNodes, 0);
+  TimePoint elapsed = now();
+
+  engine->threads.independent = 1;
+  threads_run(engine, analyse_worker);
+  engine->threads.independent = 0;
+
+  elapsed = now() - elapsed + 1;
+  uint64_t nodes = atomic_load(&aNodes);
+
+  fprintf(stderr, "\n==========================="
+                  "\nPositions       : %" FMT_Z "u"
+                  "\nTotal time (ms) : %" PRIu64
+                  "\nNodes searched  : %" PRIu64
+                  "\nNodes/second    : %" PRIu64 "\n",
+                  aNumFens, elapsed, nodes, 1000 * nodes / elapsed);
+
+  for (size_t i = 0; i < aNumFens; i++)
+    free(aFens[i]);
+  free(aFens);
+}
+
+
+// scaling() measures how the search speed grows with the number of
+// threads. It searches the bench positions for a fixed time per position
+// with 1, 2, 4, ... threads up to the given maximum and prints the time it
+// took to create the threads, the nodes per second and the speedup over a
+// single thread:
+//
+//   scaling [hash MB] [max threads] [movetime ms]
+
+void scaling(Pos *current, char *str)
+{
+  Engine *engine = current->engine;
+
+  int ttSize = 16, maxThreads = 512, movetime = 200;
+  char *token;
+  if ((token = strtok(str, " "))) {
+    ttSize = atoi(token);
+    if ((token = strtok(NULL, " "))) {
+      maxThreads = atoi(token);
+      if ((token = strtok(NULL, " ")))
+        movetime = atoi(token);
+    }
+  }
+  maxThreads = max(1, min(maxThreads, MAX_THREADS));
+
+  if (engine->signals.searching)
+    thread_wait_for_search_finished(threads_main(engine));
+
+  LimitsType limits;
+  memset(&limits, 0, sizeof(limits));
+  limits.movetime = max(movetime, 1);
+
+  // Only the totals are of interest here.
+  EngineCallbacks callbacks = engine->callbacks;
+  memset(&engine->callbacks, 0, sizeof(engine->callbacks));
+
+  delayed_settings.tt_size = ttSize;
+  process_delayed_settings();
+
+  Pos pos;
+  pos.engine = engine;
+  pos.stack = malloc(101 * sizeof(Stack));
+  pos.stack++;
+  pos.moveList = malloc(10000 * sizeof(ExtMove));
+
+  size_t num_fens = sizeof(Defaults) / sizeof(char *);
+  uint64_t baseNps = 0;
+
+  fprintf(stderr, "\n Threads   Create (ms)   Nodes/second   Speedup\n");
+
+  for (int threads = 1; ; threads = min(2 * threads, maxThreads)) {
+    TimePoint created = now();
+    delayed_settings.num_threads = threads;
+    process_delayed_settings();
+    created = now() - created;
+    search_clear(engine);
+
+    uint64_t nodes = 0;
+    TimePoint elapsed = now();
+    for (size_t i = 0; i < num_fens; i++) {
+      pos_set(&pos, Defaults[i], 0);
+      (pos.st-1)->endMoves = pos.moveList;
+      limits.startTime = now();
+      threads_start_thinking(engine, &pos, &limits);
+      thread_wait_for_search_finished(threads_main(engine));
+      nodes += threads_nodes_searched(engine);
+    }
+    elapsed = now() - elapsed + 1;
+
+    uint64_t nps = 1000 * nodes / elapsed;
+    if (threads == 1)
+      baseNps = max(nps, 1);
+    fprintf(stderr, "%8d %13" PRIu64 " %14" PRIu64 " %9.2f\n",
+                    threads, created, nps, (double)nps / baseNps);
+
+    if (threads == maxThreads)
+      break;
+  }
+
+  engine->callbacks = callbacks;
+  free(pos.stack - 1);
+  free(pos.moveList);
+}
+
+
+// ttd_run() searches the bench positions to the depth of the limits and
+// returns the time it took. The number of nodes is stored in *nodes.
+
+static TimePoint ttd_run(Engine *engine, Pos *pos, LimitsType *limits,
+                         uint64_t *nodes)
+{
+  size_t num_fens = sizeof(Defaults) / sizeof(char *);
+
+  *nodes = 0;
+  TimePoint elapsed = now();
+  for (size_t i = 0; i < num_fens; i++) {
+    search_clear(engine);
+    pos_set(pos, Defaults[i], 0);
+    (pos->st-1)->endMoves = pos->moveList;
+    limits->startTime = now();
+    threads_start_thinking(engine, pos, limits);
+    thread_wait_for_search_finished(threads_main(engine));
+    *nodes += threads_nodes_searched(engine);
+  }
+
+  return now() - elapsed + 1;
+}
+
+// ttd() compares the SMP modes by the time it takes to search the bench
+// positions to a fixed depth: lazy SMP with each helper schedule and YBWC,
+// with 8, 32 and 128 threads, or fewer if the given maximum is lower. The
+// speedup and the node overhead are relative to a single thread:
+//
+//   ttd [hash MB] [depth] [max threads]
+
+void ttd(Pos *current, char *str)
+{
+  static const char *Modes[] = { "Matrix", "Offset", "Partition", "YBWC" };
+
+  Engine *engine = current->engine;
+
+  int ttSize = 16, depth = 12, maxThreads = 128;
+  char *token;
+  if ((token = strtok(str, " "))) {
+    ttSize = atoi(token);
+    if ((token = strtok(NULL, " "))) {
+      depth = atoi(token);
+      if ((token = strtok(NULL, " ")))
+        maxThreads = atoi(token);
+    }
+  }
+  maxThreads = max(1, min(maxThreads, MAX_THREADS));
+
+  if (engine->signals.searching)
+    thread_wait_for_search_finished(threads_main(engine));
+
+  LimitsType limits;
+  memset(&limits, 0, sizeof(limits));
+  limits.depth = max(depth, 1);
+
+  EngineCallbacks callbacks = engine->callbacks;
+  memset(&engine->callbacks, 0, sizeof(engine->callbacks));
+  int schedule = option_value(OPT_HELPER_SCHEDULE);
+  int smpMode = option_value(OPT_SMP_MODE);
+
+  delayed_settings.tt_size = ttSize;
+  delayed_settings.num_threads = 1;
+  process_delayed_settings();
+
+  Pos pos;
+  pos.engine = engine;
+  pos.stack = malloc(101 * sizeof(Stack));
+  pos.stack++;
+  pos.moveList = malloc(10000 * sizeof(ExtMove));
+
+  uint64_t baseNodes;
+  TimePoint baseTime = ttd_run(engine, &pos, &limits, &baseNodes);
+
+  fprintf(stderr, "\n Threads   Mode         Time (ms)   Nodes searched"
+                  "   Speedup   Nodes\n");
+  fprintf(stderr, "%8d   %-9s %12" PRIu64 " %16" PRIu64 " %9.2f %7.2f\n",
+                  1, "-", baseTime, baseNodes, 1.0, 1.0);
+
+  for (int threads = min(8, maxThreads); threads > 1;
+       threads = min(4 * threads, maxThreads)) {
+    delayed_settings.num_threads = threads;
+    process_delayed_settings();
+
+    for (int m = 0; m < 4; m++) {
+      if (m < 3) {
+        option_set_value(OPT_SMP_MODE, SMP_LAZY);
+        option_set_value(OPT_HELPER_SCHEDULE, m);
+      } else
+        option_set_value(OPT_SMP_MODE, SMP_YBWC);
+
+      uint64_t nodes;
+      TimePoint elapsed = ttd_run(engine, &pos, &limits, &nodes);
+      fprintf(stderr, "%8d   %-9s %12" PRIu64 " %16" PRIu64 " %9.2f %7.2f\n",
+                      threads, Modes[m], elapsed, nodes,
+                      (double)baseTime / elapsed,
+                      (double)nodes / max(baseNodes, 1));
+    }
+
+    if (threads == maxThreads)
+      break;
+  }
+
+  option_set_value(OPT_HELPER_SCHEDULE, schedule);
+  option_set_value(OPT_SMP_MODE, smpMode);
+  engine->callbacks = callbacks;
+  free(pos.stack - 1);
+  free(pos.moveList);
+}
+
+// castling() checks that engines keep their castling tables apart. One
+// engine is set up with engine_set_board() at a normal chess position, the
+// other with engine_set_fen() at a Chess960 position whose rooks stand on
+// other squares. The legal moves and the FEN of the first engine must not
+// change when the second one is set up, and vice versa.
+//
+//   castling
+
+static int castling_moves(Pos *pos, ExtMove *list, char *fen)
+{
+  pos_fen(pos, fen);
+  return generate_legal(pos, list) - list;
+}
+
+void castling(Pos *current, char *str)
+{
+  (void)current, (void)str;
+
+  static const char *Fen960 = "1r2k1r1/8/8/8/8/8/8/1R2K1R1 w GBgb - 0 1";
+
+  EngineBoard b;
+  memset(&b, 0, sizeof(b));
+  b.board[SQ_A1] = b.board[SQ_H1] = W_ROOK;
+  b.board[SQ_E1] = W_KING;
+  b.board[SQ_A8] = b.board[SQ_H8] = B_ROOK;
+  b.board[SQ_E8] = B_KING;
+  b.stm = WHITE;
+  b.castling = ANY_CASTLING;
+  b.fullMove = 1;
+
+  Engine *engines[2] = { engine_create(), engine_create() };
+  ExtMove list[2][2][MAX_MOVES];
+  char fens[2][2][128];
+  int num[2][2];
+  int failed = 0;
+
+  for (int pass = 0; pass < 2; pass++) {
+    // Set up the engines in the opposite order in the second pass.
+    for (int i = 0; i < 2; i++) {
+      int e = i ^ pass;
+      if (e == 0)
+        failed |= engine_set_board(engines[0], &b);
+      else
+        engine_set_fen(engines[1], Fen960, 1);
+      num[e][0] = castling_moves(&engines[e]->root, list[e][0], fens[e][0]);
+    }
+    for (int e = 0; e < 2; e++) {
+      num[e][1] = castling_moves(&engines[e]->root, list[e][1], fens[e][1]);
+      failed |=   num[e][0] != num[e][1]
+               || strcmp(fens[e][0], fens[e][1]) != 0;
+      for (int i = 0; i < num[e][0] && i < num[e][1]; i++)
+        failed |= list[e][0][i].move != list[e][1][i].move;
+    }
+  }
+
+  for (int e = 0; e < 2; e++)
+    engine_destroy(engines[e]);
+
+  printf("castling %s\n", failed ? "failed" : "ok");
+  fflush(stdout);
+}
@@ -71,14 +71,6 @@ Bitboard PseudoAttacks[8][64];
 
 #ifndef PEDANTIC
 Bitboard EPMask[16];
-Bitboard CastlingPath[64];
-int CastlingRightsMask[64];
-Square CastlingRookSquare[16];
-Key CastlingHash[16];
-Bitboard CastlingBits[16];
-Score CastlingPSQ[16];
-Square CastlingRookFrom[16];
-Square CastlingRookTo[16];
 #endif
 
 // De Bruijn sequences. See chessprogramming.wikispaces.com/BitScan.
@@ -0,0 +1,658 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef __WIN32__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "cluster.h"
+#include "engine.h"
+#include "misc.h"
+#include "position.h"
+#include "settings.h"
+#include "thread.h"
+#include "uci.h"
+
+#ifndef __WIN32__
+
+// Nodes searched at least this deep share their TT entries.
+#define RECORD_DEPTH (8 * ONE_PLY)
+
+#define MAX_RECORDS 4096
+#define BATCH_SIZE  512
+
+#define MSG_GO     0
+#define MSG_STOP   1
+#define MSG_TT     2
+#define MSG_RESULT 3
+#define MSG_QUIT   4
+
+// A Record is a TT entry together with the full key of its position, so
+// that it can be stored in a table of any size.
+
+typedef struct {
+  Key key;
+  uint16_t move16;
+  int16_t value16;
+  int16_t eval16;
+  uint8_t bound8;
+  int8_t depth8;
+} Record;
+
+// Every search of the master has its own searchId, which the results of
+// the workers carry along. Results of an earlier search that arrive late
+// are dropped.
+
+typedef struct {
+  int type;
+  int searchId;
+  int idx;          // Index of the worker, 1 for the first
+  int chess960;
+  int numMoves;     // Searchmoves of the master
+  char fen[128];
+  Move moves[MAX_MOVES];
+} GoMsg;
+
+typedef struct {
+  int type;
+  int num;
+  Record records[BATCH_SIZE];
+} TTMsg;
+
+typedef struct {
+  int type;
+  int searchId;
+  int final;        // The search of the worker has stopped
+  Depth depth;
+  Value score;
+  int pvSize;
+  Move pv[MAX_PLY];
+} ResultMsg;
+
+typedef union {
+  int type;
+  GoMsg go;
+  TTMsg tt;
+  ResultMsg result;
+} Msg;
+
+// A Peer is a worker seen from the master, or the master seen from a
+// worker. Only the master keeps the results.
+
+typedef struct {
+  int fd;
+  int searching;
+  Depth depth;
+  RootMove rm;      // Its PV is in pv[]
+  Move pv[MAX_PLY];
+} Peer;
+
+struct ClusterComm {
+  int isWorker;
+  int listenFd;
+  char path[108];
+  int numChildren;
+  pid_t children[CLUSTER_MAX_WORKERS];
+  int numPeers;
+  Peer peers[CLUSTER_MAX_WORKERS];
+  int active;       // The master has handed the current search out
+  int searchId;     // Of the current or last search handed out
+  TimePoint lastPoll;
+
+  LOCK_T lock;      // Guards the records and the result of a worker
+  int numRecords;
+  Record records[MAX_RECORDS];
+  int updated, done;
+  Depth depth;
+  Value score;
+  int pvSize;
+  Move pv[MAX_PLY];
+};
+
+static void send_msg(int fd, const void *msg, size_t size, int flags)
+{
+  while (send(fd, msg, size, MSG_NOSIGNAL | flags) < 0 && errno == EINTR) {}
+}
+
+static void drop_peer(struct ClusterComm *c, int i)
+{
+  close(c->peers[i].fd);
+  c->peers[i] = c->peers[--c->numPeers];
+}
+
+// accept_workers() takes the workers that have connected since the last
+// call.
+
+static void accept_workers(struct ClusterComm *c)
+{
+  int fd;
+  while (   c->numPeers < CLUSTER_MAX_WORKERS
+         && (fd = accept(c->listenFd, NULL, NULL)) >= 0) {
+    memset(&c->peers[c->numPeers], 0, sizeof(Peer));
+    c->peers[c->numPeers++].fd = fd;
+  }
+}
+
+// send_records() sends the records collected so far to all peers. They
+// are sent without blocking and dropped if a peer does not keep up.
+
+static void send_records(struct ClusterComm *c)
+{
+  TTMsg msg;
+  msg.type = MSG_TT;
+
+  while (1) {
+    LOCK(c->lock);
+    msg.num = min(c->numRecords, BATCH_SIZE);
+    c->numRecords -= msg.num;
+    memcpy(msg.records, c->records + c->numRecords, msg.num * sizeof(Record));
+    UNLOCK(c->lock);
+    if (!msg.num)
+      break;
+
+    size_t size = offsetof(TTMsg, records) + msg.num * sizeof(Record);
+    for (int i = 0; i < c->numPeers; i++)
+      send_msg(c->peers[i].fd, &msg, size, MSG_DONTWAIT);
+  }
+}
+
+// merge_records() stores the received records that are deeper than what
+// the table already has for their positions.
+
+static void merge_records(Engine *engine, TTMsg *msg)
+{
+  Pos *pos = threads_main(engine); // For TT_STATS
+  (void)pos;
+
+  if (!engine->tt.mem)
+    return;
+
+  for (int i = 0; i < msg->num; i++) {
+    Record *r = &msg->records[i];
+    int found;
+    TTEntry data;
+    TTEntry *tte = tt_probe(&engine->tt, r->key, &found, &data);
+    if (!found || tte_depth(&data) < r->depth8 * ONE_PLY)
+      tte_save(tte, r->key, r->value16, r->bound8, r->depth8 * ONE_PLY,
+               r->move16, r->eval16, tt_generation(&engine->tt));
+  }
+}
+
+// receive_results() handles what the workers have sent to the master. A
+// worker that has gone away is dropped.
+
+static void receive_results(Engine *engine, struct ClusterComm *c)
+{
+  static Msg msg;
+
+  for (int i = 0; i < c->numPeers; i++) {
+    Peer *peer = &c->peers[i];
+    ssize_t n;
+    while ((n = recv(peer->fd, &msg, sizeof(msg), MSG_DONTWAIT)) > 0) {
+      if (msg.type == MSG_TT)
+        merge_records(engine, &msg.tt);
+      else if (msg.type == MSG_RESULT) {
+        if (msg.result.searchId != c->searchId)
+          continue;
+        if (msg.result.depth >= peer->depth) {
+          peer->depth = msg.result.depth;
+          peer->rm.score = msg.result.score;
+          peer->rm.pv_size = msg.result.pvSize;
+          memcpy(peer->pv, msg.result.pv, msg.result.pvSize * sizeof(Move));
+        }
+        if (msg.result.final)
+          peer->searching = 0;
+      }
+    }
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      drop_peer(c, i--);
+    }
+  }
+}
+
+// cluster_setup() makes the engine the master of a cluster listening on
+// the given socket, or on a socket of its own in /tmp if path is empty,
+// and starts numLocal workers on this machine. Without either, it ends
+// cluster mode.
+
+void cluster_setup(Engine *engine, const char *path, int numLocal)
+{
+  cluster_exit(engine);
+
+  int noPath = !*path || strcmp(path, "<empty>") == 0;
+  if (noPath && !numLocal)
+    return;
+
+  struct ClusterComm *c = calloc(sizeof(struct ClusterComm), 1);
+  if (noPath)
+    snprintf(c->path, sizeof(c->path), "/tmp/cfish-%d.sock", (int)getpid());
+  else
+    snprintf(c->path, sizeof(c->path), "%s", path);
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", c->path);
+  unlink(c->path);
+
+  c->listenFd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (   c->listenFd < 0
+      || bind(c->listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+      || listen(c->listenFd, CLUSTER_MAX_WORKERS) < 0) {
+    printf("info string Unable to listen on %s.\n", c->path);
+    fflush(stdout);
+    if (c->listenFd >= 0)
+      close(c->listenFd);
+    free(c);
+    return;
+  }
+  fcntl(c->listenFd, F_SETFL, O_NONBLOCK);
+
+  LOCK_INIT(c->lock);
+  engine->cluster = c;
+  engine->clusterDepth = RECORD_DEPTH;
+
+  // The local workers run this executable with their output discarded and
+  // the Threads and Hash of the master.
+  char threads[16], hash[16];
+  sprintf(threads, "%d", option_value(OPT_THREADS));
+  sprintf(hash, "%d", option_value(OPT_HASH));
+  char *argv[] = { "cfish", "worker", c->path, threads, hash, NULL };
+  for (int i = 0; i < min(numLocal, CLUSTER_MAX_WORKERS); i++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      int null = open("/dev/null", O_RDWR);
+      dup2(null, 0);
+      dup2(null, 1);
+      execv("/proc/self/exe", argv);
+      _exit(EXIT_FAILURE);
+    }
+    if (pid > 0)
+      c->children[c->numChildren++] = pid;
+  }
+
+  // Give them a moment to connect.
+  TimePoint end = now() + 2000;
+  do
+    accept_workers(c);
+  while (c->numPeers < c->numChildren && now() < end && !usleep(1000));
+
+  printf("info string Cluster of %d workers listening on %s.\n",
+         c->numPeers, c->path);
+  fflush(stdout);
+}
+
+// cluster_exit() ends cluster mode. The master tells its workers to quit
+// and waits for the ones it has started.
+
+void cluster_exit(Engine *engine)
+{
+  struct ClusterComm *c = engine->cluster;
+  if (!c)
+    return;
+
+  if (!c->isWorker) {
+    int quit = MSG_QUIT;
+    for (int i = 0; i < c->numPeers; i++) {
+      send_msg(c->peers[i].fd, &quit, sizeof(quit), 0);
+      close(c->peers[i].fd);
+    }
+    close(c->listenFd);
+    unlink(c->path);
+    for (int i = 0; i < c->numChildren; i++)
+      waitpid(c->children[i], NULL, 0);
+  }
+
+  LOCK_DESTROY(c->lock);
+  free(c);
+  engine->cluster = NULL;
+  engine->clusterDepth = DEPTH_MAX;
+}
+
+// cluster_go() hands the search that is starting to the workers. They
+// get the root position and the searchmoves of the master, so that they
+// search the same root moves.
+
+void cluster_go(Engine *engine, LimitsType *limits)
+{
+  struct ClusterComm *c = engine->cluster;
+  if (!c || c->isWorker)
+    return;
+
+  accept_workers(c);
+  c->active = c->numPeers > 0;
+  if (!c->active)
+    return;
+
+  static GoMsg msg;
+  msg.type = MSG_GO;
+  msg.searchId = ++c->searchId;
+  msg.chess960 = engine->root.chess960;
+  pos_fen(&engine->root, msg.fen);
+
+  msg.numMoves = limits->num_searchmoves;
+  memcpy(msg.moves, limits->searchmoves, msg.numMoves * sizeof(Move));
+
+  LOCK(c->lock);
+  c->numRecords = 0;
+  UNLOCK(c->lock);
+
+  for (int i = 0; i < c->numPeers; i++) {
+    Peer *peer = &c->peers[i];
+    msg.idx = i + 1;
+    peer->searching = 1;
+    peer->depth = DEPTH_ZERO;
+    peer->rm.pv_size = 0;
+    send_msg(peer->fd, &msg, sizeof(msg), 0);
+  }
+  c->lastPoll = now();
+}
+
+// cluster_poll() is called by the timer thread of the master during the
+// search. Every 10 ms it collects the results and records of the workers
+// and sends them its own records.
+
+void cluster_poll(Engine *engine)
+{
+  struct ClusterComm *c = engine->cluster;
+  if (c->isWorker || !c->active || now() - c->lastPoll < 10)
+    return;
+
+  c->lastPoll = now();
+  receive_results(engine, c);
+  send_records(c);
+}
+
+// cluster_stop() stops the workers when the search of the master has
+// ended and waits up to a second for their final results.
+
+void cluster_stop(Engine *engine)
+{
+  struct ClusterComm *c = engine->cluster;
+  if (!c || c->isWorker || !c->active)
+    return;
+
+  int stop = MSG_STOP;
+  for (int i = 0; i < c->numPeers; i++)
+    send_msg(c->peers[i].fd, &stop, sizeof(stop), 0);
+
+  TimePoint end = now() + 1000;
+  while (now() < end) {
+    receive_results(engine, c);
+    int searching = 0;
+    for (int i = 0; i < c->numPeers; i++)
+      searching |= c->peers[i].searching;
+    if (!searching)
+      break;
+    usleep(1000);
+  }
+  c->active = 0;
+}
+
+// is_root_move() checks that a line of a worker starts with one of the
+// moves the master has searched.
+
+static int is_root_move(Engine *engine, Move m)
+{
+  RootMoves *rm = threads_main(engine)->rootMoves;
+
+  for (size_t i = 0; i < rm->size; i++)
+    if (m && rm->move[i].pv[0] == m)
+      return 1;
+
+  return 0;
+}
+
+// cluster_best() returns the best line of a worker that has searched
+// deeper than depth with a better score than the given one, or NULL. The
+// lines are compared in the same way as those of the search threads.
+
+RootMove *cluster_best(Engine *engine, Depth *depth, Value score)
+{
+  struct ClusterComm *c = engine->cluster;
+  RootMove *best = NULL;
+
+  if (c->isWorker)
+    return NULL;
+
+  for (int i = 0; i < c->numPeers; i++) {
+    Peer *peer = &c->peers[i];
+    if (   peer->rm.pv_size
+        && is_root_move(engine, peer->pv[0])
+        && peer->depth > *depth
+        && peer->rm.score > score) {
+      best = &peer->rm;
+      best->pv = peer->pv;
+      *depth = peer->depth;
+      score = peer->rm.score;
+    }
+  }
+
+  return best;
+}
+
+// cluster_record() is called by the search threads after saving the TT
+// entry of a node of at least RECORD_DEPTH. Records that do not fit are
+// dropped.
+//
+// The entry is copied field by field while other threads may write it, so
+// the copy can mix two entries. With TT_LOCKLESS, tte_key() checks the
+// copy against the folded fields as tt_probe() does and such a mix is
+// dropped. Otherwise the key check only filters out entries that have been
+// replaced, and a torn record is as harmless as a torn TT hit.
+
+void cluster_record(Engine *engine, Key key, TTEntry *tte)
+{
+  struct ClusterComm *c = engine->cluster;
+  TTEntry e = *tte;
+
+  if (tte_key(&e) != tt_key_bits(key))
+    return;
+
+  Record r = { key, e.move16, e.value16, e.eval16,
+               (uint8_t)tte_bound(&e), e.depth8 };
+
+  LOCK(c->lock);
+  if (c->numRecords < MAX_RECORDS)
+    c->records[c->numRecords++] = r;
+  UNLOCK(c->lock);
+}
+
+// The callbacks of a worker keep its best line for the master.
+
+static void worker_on_pv(void *data, const SearchInfo *info)
+{
+  struct ClusterComm *c = ((Engine *)data)->cluster;
+
+  if (info->multiPV != 1 || info->bound != BOUND_EXACT || !info->pvSize)
+    return;
+
+  LOCK(c->lock);
+  c->depth = info->depth * ONE_PLY;
+  c->score = info->score;
+  c->pvSize = min(info->pvSize, MAX_PLY);
+  memcpy(c->pv, info->pv, c->pvSize * sizeof(Move));
+  c->updated = 1;
+  UNLOCK(c->lock);
+}
+
+static void worker_on_bestmove(void *data, Move best, Move ponder)
+{
+  struct ClusterComm *c = ((Engine *)data)->cluster;
+  (void)best, (void)ponder;
+
+  LOCK(c->lock);
+  c->done = 1;
+  UNLOCK(c->lock);
+}
+
+static void send_result(struct ClusterComm *c, int final)
+{
+  static ResultMsg msg;
+
+  msg.type = MSG_RESULT;
+  msg.searchId = c->searchId;
+  msg.final = final;
+  LOCK(c->lock);
+  msg.depth = c->depth;
+  msg.score = c->score;
+  msg.pvSize = c->pvSize;
+  memcpy(msg.pv, c->pv, c->pvSize * sizeof(Move));
+  c->updated = 0;
+  UNLOCK(c->lock);
+  send_msg(c->peers[0].fd, &msg, sizeof(msg), 0);
+}
+
+// cluster_worker() connects to the master listening on the given socket
+// and searches for it until the master quits or goes away:
+//
+//   worker <socket> [threads] [hash MB]
+
+void cluster_worker(Engine *engine, char *str)
+{
+  char *path = strtok(str, " "), *token;
+  if (!path) {
+    printf("info string Usage: worker <socket> [threads] [hash]\n");
+    fflush(stdout);
+    return;
+  }
+  int threads = 1, hash = 16;
+  if ((token = strtok(NULL, " "))) {
+    threads = atoi(token);
+    if ((token = strtok(NULL, " ")))
+      hash = atoi(token);
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    printf("info string Unable to connect to %s.\n", path);
+    fflush(stdout);
+    if (fd >= 0)
+      close(fd);
+    return;
+  }
+
+  delayed_settings.num_threads = max(threads, 1);
+  delayed_settings.tt_size = max(hash, 1);
+  process_delayed_settings();
+
+  struct ClusterComm *c = calloc(sizeof(struct ClusterComm), 1);
+  c->isWorker = 1;
+  c->listenFd = -1;
+  c->numPeers = 1;
+  c->peers[0].fd = fd;
+  LOCK_INIT(c->lock);
+  engine->cluster = c;
+  engine->clusterDepth = RECORD_DEPTH;
+
+  EngineCallbacks callbacks = engine->callbacks;
+  EngineCallbacks cb = { worker_on_pv, NULL, NULL, worker_on_bestmove,
+                         engine };
+  engine_set_callbacks(engine, &cb);
+
+  static Msg msg;
+  int searching = 0;
+
+  while (1) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, searching ? 10 : -1) > 0) {
+      ssize_t n = recv(fd, &msg, sizeof(msg), 0);
+      if (n <= 0 || msg.type == MSG_QUIT)
+        break;
+
+      if (msg.type == MSG_GO) {
+        if (searching) {
+          engine_stop(engine);
+          engine_wait(engine);
+        }
+        LimitsType limits;
+        memset(&limits, 0, sizeof(limits));
+        limits.infinite = 1;
+        limits.num_searchmoves = msg.go.numMoves;
+        memcpy(limits.searchmoves, msg.go.moves, msg.go.numMoves * sizeof(Move));
+        engine_set_fen(engine, msg.go.fen, msg.go.chess960);
+        engine->clusterIdx = msg.go.idx;
+        c->searchId = msg.go.searchId;
+        LOCK(c->lock);
+        c->updated = c->done = 0;
+        c->depth = DEPTH_ZERO;
+        c->pvSize = 0;
+        UNLOCK(c->lock);
+        limits.startTime = now();
+        engine_go(engine, &limits);
+        searching = 1;
+      }
+      else if (msg.type == MSG_STOP)
+        engine_stop(engine);
+      else if (msg.type == MSG_TT)
+        merge_records(engine, &msg.tt);
+    }
+
+    if (searching) {
+      send_records(c);
+      if (c->updated)
+        send_result(c, 0);
+      if (c->done) {
+        engine_wait(engine);
+        send_result(c, 1);
+        searching = 0;
+      }
+    }
+  }
+
+  engine_stop(engine);
+  engine_wait(engine);
+  engine_set_callbacks(engine, &callbacks);
+  engine->cluster = NULL;
+  engine->clusterDepth = DEPTH_MAX;
+  engine->clusterIdx = 0;
+  LOCK_DESTROY(c->lock);
+  free(c);
+  close(fd);
+}
+
+#else
+
+void cluster_setup(Engine *engine, const char *path, int numLocal)
+{
+  (void)engine, (void)path, (void)numLocal;
+}
+
+void cluster_exit(Engine *engine) { (void)engine; }
+void cluster_go(Engine *engine, LimitsType *limits) { (void)engine, (void)limits; }
+void cluster_poll(Engine *engine) { (void)engine; }
+void cluster_stop(Engine *engine) { (void)engine; }
+
+RootMove *cluster_best(Engine *engine, Depth *depth, Value score)
+{
+  (void)engine, (void)depth, (void)score;
+  return NULL;
+}
+
+void cluster_record(Engine *engine, Key key, TTEntry *tte)
+{
+  (void)engine, (void)key, (void)tte;
+}
+
+void cluster_worker(Engine *engine, char *str)
+{
+  (void)engine, (void)str;
+  printf("info string Cluster mode is not supported on this platform.\n");
+  fflush(stdout);
+}
+
+#endif
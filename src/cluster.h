@@ -0,0 +1,35 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include "search.h"
+#include "tt.h"
+#include "types.h"
+
+// In cluster mode one search is spread over several cfish processes that
+// talk over UNIX domain sockets. The master, the process driven by UCI,
+// listens on "Cluster Socket" and sends the root position to its workers
+// at "go". Each worker searches it with its own threads, skipping depths
+// like a helper thread of its own index, until the master stops it. On
+// the way, master and workers send each other the TT entries of deep
+// nodes, and the workers report their best line after every iteration.
+// The master plays the best line of all processes.
+//
+// Workers are started with "cfish worker <socket> [threads] [hash]", by
+// default with 1 thread and 16 MB, or started on the same machine by the
+// master with "Cluster Workers". Those take the Threads and Hash of the
+// master at the time "Cluster Workers" or "Cluster Socket" is set, so set
+// Threads and Hash first. Each worker has a table of its own, so the
+// cluster uses Hash MB once per process.
+
+#define CLUSTER_MAX_WORKERS 64
+
+void cluster_setup(Engine *engine, const char *path, int numLocal);
+void cluster_exit(Engine *engine);
+void cluster_go(Engine *engine, LimitsType *limits);
+void cluster_poll(Engine *engine);
+void cluster_stop(Engine *engine);
+RootMove *cluster_best(Engine *engine, Depth *depth, Value score);
+void cluster_record(Engine *engine, Key key, TTEntry *tte);
+void cluster_worker(Engine *engine, char *str);
+
+#endif
@@ -0,0 +1,262 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2016 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitboard.h"
+#include "cluster.h"
+#include "endgame.h"
+#include "engine.h"
+#include "movegen.h"
+#include "pawns.h"
+#include "tbprobe.h"
+#include "uci.h"
+
+extern const char *PieceToChar;
+
+// cfish_init() computes the lookup tables and sets up the UCI options and
+// the process-wide parts of the thread code.
+
+void cfish_init(void)
+{
+  psqt_init();
+  zob_init();
+  bitboards_init();
+  bitbases_init();
+  search_init();
+  pawn_init();
+  endgames_init();
+  threads_init();
+  options_init();
+}
+
+// cfish_exit() releases what cfish_init() set up. All engines must have
+// been destroyed.
+
+void cfish_exit(void)
+{
+  threads_exit();
+  TB_free();
+  options_free();
+}
+
+// engine_create() returns a new engine with one search thread, set up at
+// the starting position. The transposition table is allocated by
+// engine_set_hash(), or with the default size by the first engine_go().
+
+Engine *engine_create(void)
+{
+  Engine *engine = calloc(sizeof(Engine), 1);
+
+  engine->root.engine = engine;
+  engine->root.stack = malloc(1000 * sizeof(Stack));
+  engine->root.stack++;
+  engine->root.moveList = malloc(1000 * sizeof(ExtMove));
+  engine->root.stack[-1].endMoves = engine->root.moveList;
+  engine_set_fen(engine, StartFEN, 0);
+
+  LOCK_INIT(engine->signals.lock);
+  LOCK_INIT(engine->split.lock);
+  engine->mainThread.previousScore = VALUE_INFINITE;
+  engine->lastInfoTime = now();
+  engine->clusterDepth = DEPTH_MAX;
+  threads_pool_init(engine);
+
+  return engine;
+}
+
+// engine_destroy() waits for a running search to finish and releases the
+// threads and the transposition table of the engine.
+
+void engine_destroy(Engine *engine)
+{
+  engine_wait(engine);
+  cluster_exit(engine);
+  threads_pool_exit(engine);
+  tt_free(&engine->tt);
+  LOCK_DESTROY(engine->signals.lock);
+  LOCK_DESTROY(engine->split.lock);
+  free(engine->root.stack - 1);
+  free(engine->root.moveList);
+  free(engine);
+}
+
+void engine_set_callbacks(Engine *engine, const EngineCallbacks *cb)
+{
+  engine->callbacks = *cb;
+}
+
+void engine_set_threads(Engine *engine, size_t num)
+{
+  engine_wait(engine);
+  threads_set_number(engine, max(num, 1));
+}
+
+void engine_set_hash(Engine *engine, size_t mbSize)
+{
+  engine_wait(engine);
+  tt_resize(engine, max(mbSize, 1));
+}
+
+// engine_new_game() forgets what was learnt from the previous searches.
+
+void engine_new_game(Engine *engine)
+{
+  engine_wait(engine);
+  if (engine->tt.mem)
+    search_clear(engine);
+  engine->time.availableNodes = 0;
+}
+
+// engine_set_fen() sets the root position from a FEN string.
+
+void engine_set_fen(Engine *engine, const char *fen, int chess960)
+{
+  char buf[128];
+
+  strncpy(buf, fen, 127);
+  buf[127] = 0;
+  pos_set(&engine->root, buf, chess960);
+}
+
+// engine_set_board() sets the root position from an EngineBoard. It
+// returns 0 if the board holds only valid piece codes and has been set.
+
+int engine_set_board(Engine *engine, const EngineBoard *b)
+{
+  char fen[128], *str = fen;
+
+  for (int s = 0; s < 64; s++) {
+    int pc = b->board[s];
+    if (pc && (pc < W_PAWN || (pc > W_KING && pc < B_PAWN) || pc > B_KING))
+      return 1;
+  }
+
+  for (int r = 7; r >= 0; r--) {
+    for (int f = 0; f < 8; f++) {
+      int empty = 0;
+      for (; f < 8 && !b->board[8 * r + f]; f++)
+        empty++;
+      if (empty)
+        *str++ = '0' + empty;
+      if (f < 8)
+        *str++ = PieceToChar[b->board[8 * r + f]];
+    }
+    if (r > 0)
+      *str++ = '/';
+  }
+
+  *str++ = ' ';
+  *str++ = b->stm == WHITE ? 'w' : 'b';
+  *str++ = ' ';
+  if (b->castling & WHITE_OO)  *str++ = 'K';
+  if (b->castling & WHITE_OOO) *str++ = 'Q';
+  if (b->castling & BLACK_OO)  *str++ = 'k';
+  if (b->castling & BLACK_OOO) *str++ = 'q';
+  if (!(b->castling & ANY_CASTLING))
+    *str++ = '-';
+  *str++ = ' ';
+  if (b->epSquare) {
+    *str++ = 'a' + file_of(b->epSquare);
+    *str++ = '1' + rank_of(b->epSquare);
+  } else
+    *str++ = '-';
+  sprintf(str, " %d %d", b->rule50, b->fullMove);
+
+  pos_set(&engine->root, fen, b->chess960);
+  return 0;
+}
+
+// engine_do_move() plays a move in the root position. It returns 0 if the
+// move is legal and has been played.
+
+int engine_do_move(Engine *engine, Move m)
+{
+  Pos *pos = &engine->root;
+  ExtMove list[MAX_MOVES];
+  ExtMove *last = generate_legal(pos, list);
+  ExtMove *p = list;
+
+  while (p < last && p->move != m)
+    p++;
+  if (!m || p == last)
+    return 1;
+
+  pos->st->endMoves = (pos->st-1)->endMoves;
+  do_move(pos, m, gives_check(pos, pos->st, m));
+  pos->gamePly++;
+  return 0;
+}
+
+// engine_go() starts a search of the root position and returns at once.
+// The result is passed to the on_bestmove callback.
+
+void engine_go(Engine *engine, LimitsType *limits)
+{
+  if (!engine->tt.mem)
+    tt_resize(engine, 16);
+
+  cluster_go(engine, limits);
+  threads_start_thinking(engine, &engine->root, limits);
+}
+
+// engine_stop() makes a running search stop as soon as possible, also if
+// it is pondering or in an infinite search.
+
+void engine_stop(Engine *engine)
+{
+  if (!engine->signals.searching)
+    return;
+
+  signal_stop(engine);
+  LOCK(engine->signals.lock);
+  if (engine->signals.sleeping)
+    thread_start_searching(threads_main(engine), 1); // Wake up main thread.
+  engine->signals.sleeping = 0;
+  UNLOCK(engine->signals.lock);
+}
+
+// engine_ponderhit() switches a pondering search to a normal search. The
+// search stops right away if it only waited for the ponderhit.
+
+void engine_ponderhit(Engine *engine)
+{
+  engine->limits.ponder = 0; // Switch to normal search
+  if (engine->signals.stopOnPonderhit)
+    signal_stop(engine);
+  LOCK(engine->signals.lock);
+  if (engine->signals.sleeping) {
+    signal_stop(engine);
+    thread_start_searching(threads_main(engine), 1); // Wake up main thread.
+    engine->signals.sleeping = 0;
+  }
+  UNLOCK(engine->signals.lock);
+}
+
+// engine_wait() waits until the running search, if any, has finished.
+
+void engine_wait(Engine *engine)
+{
+  if (engine->signals.searching)
+    thread_wait_for_search_finished(threads_main(engine));
+}
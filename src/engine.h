@@ -0,0 +1,145 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2016 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "search.h"
+#include "thread.h"
+#include "timeman.h"
+#include "tt.h"
+#include "types.h"
+
+// An Engine holds everything a search needs beyond the tables that are
+// computed once at startup: its threads, its transposition table, the
+// limits and signals of the current search and the state that carries
+// over from one search to the next. Every thread finds its engine through
+// pos->engine, so that any number of engines can search at the same time
+// in one process.
+
+// SearchInfo describes one PV line reported by a search. The pv array
+// belongs to the search thread and is valid only during the callback.
+
+struct SearchInfo {
+  int depth, selDepth;
+  int multiPV;     // Line number, starting at 1
+  Value score;
+  int bound;       // BOUND_EXACT, or BOUND_LOWER/UPPER if the score failed
+  int tbScore;     // The score comes from the tablebases
+  uint64_t nodes, nps, tbHits;
+  int time;        // Milliseconds since the search started
+  int hashfull;    // Permill, or -1 if not sampled (first second)
+  size_t pvSize;   // Zero if the root position has no legal moves
+  const Move *pv;
+};
+
+typedef struct SearchInfo SearchInfo;
+
+// EngineCallbacks receive the output of a search as plain values instead
+// of UCI text. They are called from the main search thread; any of them
+// may be NULL. The UCI front end installs callbacks that print the usual
+// "info" and "bestmove" lines.
+
+struct EngineCallbacks {
+  void (*on_pv)(void *data, const SearchInfo *info);
+  void (*on_currmove)(void *data, int depth, Move move, int number);
+  void (*on_nodes)(void *data, uint64_t nodes, int time); // When stopped
+  void (*on_bestmove)(void *data, Move best, Move ponder);
+  void *data;
+};
+
+typedef struct EngineCallbacks EngineCallbacks;
+
+// EngineBoard is a position in binary form for engine_set_board(). Pieces
+// are coded as in types.h (W_PAWN ... B_KING, 0 for an empty square) and
+// indexed by square, A1 = 0. The castling rights are the WHITE_OO ...
+// BLACK_OOO bits and epSquare is 0 if there is no en passant square.
+
+struct EngineBoard {
+  uint8_t board[64];
+  int stm;
+  int castling;
+  int epSquare;
+  int rule50;
+  int fullMove;
+  int chess960;
+};
+
+typedef struct EngineBoard EngineBoard;
+
+struct Engine {
+  Pos root; // Position to search from, see engine_set_fen()
+  EngineCallbacks callbacks;
+  ThreadPool threads;
+  TranspositionTable tt;
+  SignalsType signals;
+  LimitsType limits;
+  struct TimeManagement time;
+  MainThread mainThread;
+  struct EasyMove em;
+  struct StopLatency stopLatency;
+  struct SearchLatency latency;
+  struct SplitPV split;
+  struct YBWC ybwc;
+  struct ClusterComm *cluster; // See cluster.h, NULL if not in a cluster
+  int clusterIdx;              // Index of a worker process, 0 otherwise
+  Depth clusterDepth;          // Depth of the nodes shared with the cluster
+  TimePoint lastInfoTime;
+  Value drawValue[2];
+  int tbCardinality;
+  int tbRootInTB;
+  int tbUseRule50;
+  Depth tbProbeDepth;
+  Value tbScore;
+};
+
+// signal_stop() raises signals.stop and notes when the search was first
+// asked to stop, see SearchLatency.
+
+INLINE void signal_stop(Engine *engine)
+{
+  unsigned long long none = 0;
+  atomic_compare_exchange_strong(&engine->latency.stopTime, &none, now_us());
+  engine->signals.stop = 1;
+}
+
+// An embedding program calls cfish_init() once, then creates engines with
+// engine_create(). UCI options such as MultiPV or SyzygyPath are shared by
+// all engines and set with option_set_by_name().
+
+void cfish_init(void);
+void cfish_exit(void);
+
+Engine *engine_create(void);
+void engine_destroy(Engine *engine);
+void engine_set_callbacks(Engine *engine, const EngineCallbacks *cb);
+void engine_set_threads(Engine *engine, size_t num);
+void engine_set_hash(Engine *engine, size_t mbSize);
+void engine_new_game(Engine *engine);
+void engine_set_fen(Engine *engine, const char *fen, int chess960);
+int engine_set_board(Engine *engine, const EngineBoard *b);
+int engine_do_move(Engine *engine, Move m);
+void engine_go(Engine *engine, LimitsType *limits);
+void engine_stop(Engine *engine);
+void engine_ponderhit(Engine *engine);
+void engine_wait(Engine *engine);
+
+#endif
@@ -18,38 +18,23 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <stdio.h>
-
-#include "bitboard.h"
-#include "endgame.h"
-#include "pawns.h"
-#include "position.h"
-#include "search.h"
-#include "thread.h"
-#include "tt.h"
+#include "engine.h"
+#include "misc.h"
+#include "settings.h"
 #include "uci.h"
-#include "tbprobe.h"
 
 int main(int argc, char **argv)
 {
   print_engine_info(0);
 
-  psqt_init();
-  zob_init();
-  bitboards_init();
-  bitbases_init();
-  search_init();
-  pawn_init();
-  endgames_init();
-  threads_init();
-  options_init();
+  cfish_init();
+  UciEngine = engine_create();
+  process_delayed_settings_async();
 
   uci_loop(argc, argv);
 
-  threads_exit();
-  TB_free();
-  options_free();
-  tt_free();
+  engine_destroy(UciEngine);
+  cfish_exit();
 
   return 0;
 }
@@ -70,6 +70,14 @@ INLINE TimePoint now() {
   return 1000 * (uint64_t)tv.tv_sec + (uint64_t)tv.tv_usec / 1000;
 }
 
+// now_us() returns the time in microseconds, for latency measurements.
+
+INLINE uint64_t now_us() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return 1000000 * (uint64_t)tv.tv_sec + (uint64_t)tv.tv_usec;
+}
+
 #ifndef __WIN32__
 extern pthread_mutex_t io_mutex;
 #define IO_LOCK   pthread_mutex_lock(&io_mutex)
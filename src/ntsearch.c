@@ -21,8 +21,8 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
   assert(DEPTH_ZERO < depth && depth < DEPTH_MAX);
   assert(!(PvNode && cutNode));
 
-  Move pv[MAX_PLY+1], quietsSearched[64];
-  TTEntry *tte;
+  Move quietsSearched[64];
+  TTEntry *tte, ttData;
   Key posKey;
   Move ttMove, move, excludedMove, bestMove;
   Depth extension, newDepth;
@@ -31,6 +31,22 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
   int captureOrPromotion, doFullDepthSearch, moveCountPruning;
   Piece moved_piece;
   int moveCount, quietCount;
+  SplitPoint *sp = ss->splitPoint;
+
+  // A thread joining a split point searches the remaining moves of the
+  // node, which has been set up by split_point_open().
+  if (sp) {
+    ss->splitPoint = NULL;
+    inCheck = !!pos_checkers();
+    tte = NULL;
+    posKey = 0;
+    ttValue = VALUE_NONE;
+    ttMove = excludedMove = 0;
+    bestValue = sp->bestValue;
+    bestMove = 0;
+    moveCount = quietCount = 0;
+    goto moves_loop;
+  }
 
   // Step 1. Initialize node
   inCheck = !!pos_checkers();
@@ -38,27 +54,16 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
   bestValue = -VALUE_INFINITE;
   ss->ply = (ss-1)->ply + 1;
 
-  // Check for the available remaining time
-  if (load_rlx(pos->resetCalls)) {
-    store_rlx(pos->resetCalls, 0);
-    pos->callsCnt = 0;
-  }
-  if (++pos->callsCnt > 4096) {
-    for (size_t idx = 0; idx < Threads.num_threads; idx++)
-      store_rlx(Threads.pos[idx]->resetCalls, 1);
-
-    check_time();
-  }
-
   // Used to send selDepth info to GUI
   if (PvNode && pos->maxPly < ss->ply)
     pos->maxPly = ss->ply;
 
   if (!rootNode) {
     // Step 2. Check for aborted search and immediate draw
-    if (load_rlx(Signals.stop) || is_draw(pos) || ss->ply >= MAX_PLY)
+    if (   load_rlx(pos->engine->signals.stop) || cutoff_occurred(pos)
+        || is_draw(pos) || ss->ply >= MAX_PLY)
       return ss->ply >= MAX_PLY && !inCheck ? evaluate(pos)
-                                            : DrawValue[pos_stm()];
+                                            : pos->engine->drawValue[pos_stm()];
 
     // Step 3. Mate distance pruning. Even if we mate at the next move our
     // score would be at best mate_in(ss->ply+1), but if alpha is already
@@ -91,19 +96,19 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
   // partial search to overwrite a previous full search TT value, so we
   // use a different position key in case of an excluded move.
   excludedMove = ss->excludedMove;
-  posKey = pos_key() ^ (Key)excludedMove;
-  tte = tt_probe(posKey, &ttHit);
-  ttValue = ttHit ? value_from_tt(tte_value(tte), ss->ply) : VALUE_NONE;
+  posKey = excludedMove ? pos_key() ^ make_key(excludedMove) : pos_key();
+  tte = tt_probe(&pos->engine->tt, posKey, &ttHit, &ttData);
+  ttValue = ttHit ? value_from_tt(tte_value(&ttData), ss->ply) : VALUE_NONE;
   ttMove =  rootNode ? pos->rootMoves->move[pos->PVIdx].pv[0]
-          : ttHit    ? tte_move(tte) : 0;
+          : ttHit    ? tte_move(&ttData) : 0;
 
   // At non-PV nodes we check for an early TT cutoff.
   if (  !PvNode
       && ttHit
-      && tte_depth(tte) >= depth
+      && tte_depth(&ttData) >= depth
       && ttValue != VALUE_NONE // Possible in case of TT access race.
-      && (ttValue >= beta ? (tte_bound(tte) & BOUND_LOWER)
-                          : (tte_bound(tte) & BOUND_UPPER))) {
+      && (ttValue >= beta ? (tte_bound(&ttData) & BOUND_LOWER)
+                          : (tte_bound(&ttData) & BOUND_UPPER))) {
     ss->currentMove = ttMove; // Can be 0.
 
     // If ttMove is quiet, update killers, history, counter move on TT hit.
@@ -126,11 +131,12 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
   }
 
   // Step 4a. Tablebase probe
-  if (!rootNode && TB_Cardinality) {
+  if (!rootNode && pos->engine->tbCardinality) {
     int piecesCnt = popcount(pieces());
+    int cardinality = pos->engine->tbCardinality;
 
-    if (    piecesCnt <= TB_Cardinality
-        && (piecesCnt <  TB_Cardinality || depth >= TB_ProbeDepth)
+    if (    piecesCnt <= cardinality
+        && (piecesCnt <  cardinality || depth >= pos->engine->tbProbeDepth)
         &&  pos_rule50_count() == 0
         && !can_castle_cr(ANY_CASTLING)) {
 
@@ -139,7 +145,7 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
       if (found) {
         pos->tb_hits++;
 
-        int drawScore = TB_UseRule50 ? 1 : 0;
+        int drawScore = pos->engine->tbUseRule50 ? 1 : 0;
 
         value =  v < -drawScore ? -VALUE_MATE + MAX_PLY + ss->ply
                : v >  drawScore ?  VALUE_MATE - MAX_PLY - ss->ply
@@ -147,7 +153,7 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
 
         tte_save(tte, posKey, value_to_tt(value, ss->ply), BOUND_EXACT,
                  min(DEPTH_MAX - ONE_PLY, depth + 6 * ONE_PLY),
-                 0, VALUE_NONE, tt_generation());
+                 0, VALUE_NONE, tt_generation(&pos->engine->tt));
 
         return value;
       }
@@ -160,12 +166,12 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
     goto moves_loop;
   } else if (ttHit) {
     // Never assume anything on values stored in TT
-    if ((ss->staticEval = eval = tte_eval(tte)) == VALUE_NONE)
+    if ((ss->staticEval = eval = tte_eval(&ttData)) == VALUE_NONE)
       eval = ss->staticEval = evaluate(pos);
 
     // Can ttValue be used as a better position evaluation?
     if (ttValue != VALUE_NONE)
-      if (tte_bound(tte) & (ttValue > eval ? BOUND_LOWER : BOUND_UPPER))
+      if (tte_bound(&ttData) & (ttValue > eval ? BOUND_LOWER : BOUND_UPPER))
         eval = ttValue;
   } else {
     eval = ss->staticEval =
@@ -173,7 +179,7 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
                                      : -(ss-1)->staticEval + 2 * Tempo;
 
     tte_save(tte, posKey, VALUE_NONE, BOUND_NONE, DEPTH_NONE, 0,
-             ss->staticEval, tt_generation());
+             ss->staticEval, tt_generation(&pos->engine->tt));
   }
 
   if (ss->skipEarlyPruning)
@@ -285,8 +291,8 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
 #endif
     ss->skipEarlyPruning = 0;
 
-    tte = tt_probe(posKey, &ttHit);
-    ttMove = ttHit ? tte_move(tte) : 0;
+    tte = tt_probe(&pos->engine->tt, posKey, &ttHit, &ttData);
+    ttMove = ttHit ? tte_move(&ttData) : 0;
   }
 
 moves_loop: // When in check search starts from here.
@@ -295,22 +301,24 @@ moves_loop: // When in check search starts from here.
   CounterMoveStats *fmh  = (ss-2)->counterMoves;
   CounterMoveStats *fmh2 = (ss-4)->counterMoves;
 
-  mp_init(pos, ttMove, depth);
+  if (!sp)
+    mp_init(pos, ttMove, depth);
   value = bestValue; // Workaround a bogus 'uninitialized' warning under gcc
   improving =   ss->staticEval >= (ss-2)->staticEval
           /* || ss->staticEval == VALUE_NONE Already implicit in the previous condition */
              ||(ss-2)->staticEval == VALUE_NONE;
 
   singularExtensionNode =   !rootNode
+                         && !sp
                          &&  depth >= 8 * ONE_PLY
                          &&  ttMove
                          && !excludedMove // Recursive singular search is not allowed
-                         && (tte_bound(tte) & BOUND_LOWER)
-                         &&  tte_depth(tte) >= depth - 3 * ONE_PLY;
+                         && (tte_bound(&ttData) & BOUND_LOWER)
+                         &&  tte_depth(&ttData) >= depth - 3 * ONE_PLY;
 
   // Step 11. Loop through moves
   // Loop through all pseudo-legal moves until no moves remain or a beta cutoff occurs
-  while ((move = next_move(pos))) {
+  while ((move = sp ? split_point_next_move(sp) : next_move(pos))) {
     assert(move_is_ok(move));
 
     if (move == excludedMove)
@@ -329,17 +337,25 @@ moves_loop: // When in check search starts from here.
         continue;
     }
 
-    ss->moveCount = ++moveCount;
-
-    if (rootNode && pos->thread_idx == 0 && time_elapsed() > 3000) {
-      char buf[16];
-      IO_LOCK;
-      printf("info depth %d currmove %s currmovenumber %d\n",
-             depth / ONE_PLY,
-             uci_move(buf, move, is_chess960()),
-             moveCount + pos->PVIdx);
-      fflush(stdout);
-      IO_UNLOCK;
+    // The move count of a split point is shared, so only legal moves are
+    // counted there.
+    if (sp) {
+      if (!is_legal(pos, move))
+        continue;
+      LOCK(sp->lock);
+      ss->moveCount = moveCount = ++sp->moveCount;
+      bestValue = sp->bestValue;
+      alpha = sp->alpha;
+      UNLOCK(sp->lock);
+    } else
+      ss->moveCount = ++moveCount;
+
+    if (rootNode && pos->thread_idx == 0 && !pos->engine->threads.independent
+        && pos->engine->callbacks.on_currmove
+        && time_elapsed(pos->engine) > 3000) {
+      pos->engine->callbacks.on_currmove(pos->engine->callbacks.data,
+                                         depth / ONE_PLY, move,
+                                         moveCount + pos->PVIdx);
     }
 
     if (PvNode)
@@ -431,10 +447,10 @@ moves_loop: // When in check search starts from here.
     }
 
     // Speculative prefetch as early as possible
-    prefetch(tt_first_entry(key_after(pos, move)));
+    prefetch(tt_first_entry(&pos->engine->tt, key_after(pos, move)));
 
     // Check for legality just before making the move
-    if (!rootNode && !is_legal(pos, move)) {
+    if (!rootNode && !sp && !is_legal(pos, move)) {
       ss->moveCount = --moveCount;
       continue;
     }
@@ -498,7 +514,7 @@ moves_loop: // When in check search starts from here.
     // high (in the latter case search only if value < beta), otherwise let the
     // parent node fail low with value <= alpha and try another move.
     if (PvNode && (moveCount == 1 || (value > alpha && (rootNode || value < beta)))) {
-      (ss+1)->pv = pv;
+      (ss+1)->pv = pos->pvTable[ss->ply + 1];
       (ss+1)->pv[0] = 0;
 
       value = newDepth <   ONE_PLY ?
@@ -516,9 +532,27 @@ moves_loop: // When in check search starts from here.
     // Finished searching the move. If a stop occurred, the return value of
     // the search cannot be trusted, and we return immediately without
     // updating best move, PV and TT.
-    if (load_rlx(Signals.stop))
+    if (load_rlx(pos->engine->signals.stop) || cutoff_occurred(pos))
       return 0;
 
+    if (sp) {
+      LOCK(sp->lock);
+      if (value > sp->bestValue) {
+        sp->bestValue = value;
+        if (value > sp->alpha) {
+          sp->bestMove = move;
+          if (PvNode)
+            update_pv(ss->pv, move, (ss+1)->pv);
+          if (PvNode && value < beta)
+            sp->alpha = value;
+          else
+            atomic_store(&sp->cutoff, 1);
+        }
+      }
+      UNLOCK(sp->lock);
+      continue;
+    }
+
     if (rootNode) {
       RootMove *rm = NULL;
       for (size_t idx = 0; idx < pos->rootMoves->size; idx++)
@@ -541,7 +575,7 @@ moves_loop: // When in check search starts from here.
         // iteration. This information is used for time management: When
         // the best move changes frequently, we allocate some more time.
         if (moveCount > 1 && pos->thread_idx == 0)
-          mainThread.bestMoveChanges++;
+          pos->engine->mainThread.bestMoveChanges++;
       } else
         // All other moves but the PV are set to the lowest value: this is
         // not a problem when sorting because the sort is stable and the
@@ -556,9 +590,10 @@ moves_loop: // When in check search starts from here.
         // If there is an easy move for this position, clear it if unstable
         if (    PvNode
             &&  pos->thread_idx == 0
-            &&  easy_move_get(pos_key())
-            && (move != easy_move_get(pos_key()) || moveCount > 1))
-          easy_move_clear();
+            &&  easy_move_get(&pos->engine->em, pos_key())
+            && (   move != easy_move_get(&pos->engine->em, pos_key())
+                || moveCount > 1))
+          easy_move_clear(&pos->engine->em);
 
         bestMove = move;
 
@@ -576,13 +611,45 @@ moves_loop: // When in check search starts from here.
 
     if (!captureOrPromotion && move != bestMove && quietCount < 64)
       quietsSearched[quietCount++] = move;
+
+    // Step 19. Split the remaining moves among idle helpers (YBWC)
+    if (    depth >= pos->engine->ybwc.splitDepth
+        && !rootNode
+        && !excludedMove
+        &&  pos->splitPointsSize < MAX_SPLITPOINTS_PER_THREAD
+        &&  atomic_load_explicit(&pos->engine->ybwc.idle, memory_order_relaxed))
+    {
+      SplitPoint *newSp = split_point_open(pos, alpha, beta, bestValue,
+                                           bestMove, moveCount, depth,
+                                           PvNode, cutNode);
+      ss->splitPoint = newSp;
+#if PvNode
+      search_PV(pos, ss, alpha, beta, depth);
+#else
+      search_NonPV(pos, ss, alpha, depth, cutNode);
+#endif
+      split_point_close(pos, newSp);
+
+      if (load_rlx(pos->engine->signals.stop) || cutoff_occurred(pos))
+        return 0;
+
+      bestValue = newSp->bestValue;
+      bestMove = newSp->bestMove;
+      moveCount = newSp->moveCount;
+      break;
+    }
   }
 
+  // Threads searching a split point leave the rest to the one that opened
+  // it, see Step 19.
+  if (sp)
+    return bestValue;
+
   // The following condition would detect a stop only after move loop has
   // been completed. But in this case bestValue is valid because we have
   // fully searched our subtree, and we can anyhow save the result in TT.
   /*
-  if (Signals.stop)
+  if (pos->engine->signals.stop)
     return VALUE_DRAW;
   */
 
@@ -592,7 +659,7 @@ moves_loop: // When in check search starts from here.
   // search then return a fail low score.
   if (!moveCount)
     bestValue = excludedMove ? alpha
-               :     inCheck ? mated_in(ss->ply) : DrawValue[pos_stm()];
+               :     inCheck ? mated_in(ss->ply) : pos->engine->drawValue[pos_stm()];
   else if (bestMove) {
     int d = depth / ONE_PLY;
 
@@ -623,7 +690,10 @@ moves_loop: // When in check search starts from here.
   tte_save(tte, posKey, value_to_tt(bestValue, ss->ply),
            bestValue >= beta ? BOUND_LOWER :
            PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER,
-           depth, bestMove, ss->staticEval, tt_generation());
+           depth, bestMove, ss->staticEval, tt_generation(&pos->engine->tt));
+
+  if (depth >= pos->engine->clusterDepth)
+    cluster_record(pos->engine, posKey, tte);
 
   assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
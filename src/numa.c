@@ -20,6 +20,7 @@ int numa_avail;
 #ifndef __WIN32__
 static int *num_logical_cores;
 static struct bitmask **nodemask;
+static struct bitmask *run_nodes; // Nodes with cpus we may run on
 
 // Override libnuma's numa_warn().
 void numa_warn(int num, char *fmt, ...)
@@ -48,7 +49,11 @@ void numa_init(void)
       printf("node %d is absent.\n", node);
 #endif
 
-  // Determine number of logical and physical cores per node.
+  // Determine number of logical and physical cores per node, counting
+  // only the cpus in our affinity mask.
+  struct bitmask *allowed = numa_allocate_cpumask();
+  numa_sched_getaffinity(0, allowed);
+  run_nodes = numa_allocate_nodemask();
   num_physical_cores = malloc(num_nodes * sizeof(int));
   num_logical_cores = malloc(num_nodes * sizeof(int));
   nodemask = malloc(num_nodes * sizeof(struct bitmask *));
@@ -64,7 +69,9 @@ void numa_init(void)
     num_logical_cores[node] = 0;
     numa_node_to_cpus(node, cpu_mask);
     for (int cpu = 0; cpu < num_cpus; cpu++)
-      if (numa_bitmask_isbitset(cpu_mask, cpu)) {
+      if (   numa_bitmask_isbitset(cpu_mask, cpu)
+          && numa_bitmask_isbitset(allowed, cpu)) {
+        numa_bitmask_setbit(run_nodes, node);
         num_logical_cores[node]++;
         // Find out about the thread_siblings of this cpu.
         sprintf(name,
@@ -78,6 +85,7 @@ void numa_init(void)
       }
   }
   numa_bitmask_free(cpu_mask);
+  numa_bitmask_free(allowed);
   if (line) free(line);
 #if 0
   for (int node = 0; node < num_nodes; node++)
@@ -88,7 +96,7 @@ void numa_init(void)
   delayed_settings.numa_enabled = 1;
   settings.numa_enabled = 0;
   delayed_settings.mask = numa_allocate_nodemask();
-  copy_bitmask_to_bitmask(numa_all_nodes_ptr, delayed_settings.mask);
+  copy_bitmask_to_bitmask(run_nodes, delayed_settings.mask);
   settings.mask = numa_allocate_nodemask();
 }
 
@@ -102,10 +110,27 @@ void numa_exit(void)
   free(nodemask);
   free(num_physical_cores);
   free(num_logical_cores);
+  numa_bitmask_free(run_nodes);
   numa_bitmask_free(delayed_settings.mask);
   numa_bitmask_free(settings.mask);
 }
 
+// nodes_we_run_on() drops the nodes without cpus in our affinity mask from
+// the given mask and returns whether any node is left.
+
+static int nodes_we_run_on(struct bitmask *mask)
+{
+  int left = 0;
+  for (int node = 0; node < num_nodes; node++)
+    if (numa_bitmask_isbitset(mask, node)) {
+      if (numa_bitmask_isbitset(run_nodes, node))
+        left = 1;
+      else
+        numa_bitmask_clearbit(mask, node);
+    }
+  return left;
+}
+
 void read_numa_nodes(char *str)
 {
   struct bitmask *mask = NULL;
@@ -128,6 +153,9 @@ void read_numa_nodes(char *str)
     printf("info string NUMA disabled.\n");
     delayed_settings.numa_enabled = 0;
   }
+  else if (!nodes_we_run_on(mask)) {
+    printf("info string None of these NUMA nodes has cpus we may run on.\n");
+  }
   else {
     printf("info string NUMA enabled.\n");
     delayed_settings.numa_enabled = 1;
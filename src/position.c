@@ -7,6 +7,7 @@
 #include "misc.h"
 #include "movegen.h"
 #include "pawns.h"
+#include "engine.h"
 #include "position.h"
 #include "thread.h"
 #include "tt.h"
@@ -189,9 +190,6 @@ void pos_set(Pos *pos, char *fen, int isChess960)
     pos->pieceList[i] = SQ_NONE;
   for (int i = 0; i < 16; i++)
     pos->pieceCount[i] = 16 * i;
-#else
-  for (Square s = 0; s < 64; s++)
-    CastlingRightsMask[s] = ANY_CASTLING;
 #endif
 
   // Piece placement
@@ -288,39 +286,27 @@ static void set_castling_right(Pos *pos, int c, Square rfrom)
 
   pos->st->castlingRights |= cr;
 
-#ifdef PEDANTIC
   pos->castlingRightsMask[kfrom] |= cr;
   pos->castlingRightsMask[rfrom] |= cr;
   pos->castlingRookSquare[cr] = rfrom;
 
-  for (Square s = min(rfrom, rto); s <= max(rfrom, rto); s++)
-    if (s != kfrom && s != rfrom)
-      pos->castlingPath[cr] |= sq_bb(s);
-
-  for (Square s = min(kfrom, kto); s <= max(kfrom, kto); s++)
-    if (s != kfrom && s != rfrom)
-      pos->castlingPath[cr] |= sq_bb(s);
-#else
-  CastlingRightsMask[kfrom] &= ~cr;
-  CastlingRightsMask[rfrom] &= ~cr;
-//  CastlingToSquare[rfrom & 0x0f] = kto;
+#ifndef PEDANTIC
   int rook = make_piece(c, ROOK);
-  CastlingHash[kto & 0x0f] = zob.psq[rook][rto] ^ zob.psq[rook][rfrom];
-  CastlingPSQ[kto & 0x0f] = psqt.psq[rook][rto] - psqt.psq[rook][rfrom];
-  CastlingBits[kto & 0x0f] = sq_bb(rto) ^ sq_bb(rfrom);
+  pos->castlingHash[kto & 0x0f] = zob.psq[rook][rto] ^ zob.psq[rook][rfrom];
+  pos->castlingPSQ[kto & 0x0f] = psqt.psq[rook][rto] - psqt.psq[rook][rfrom];
+  pos->castlingBits[kto & 0x0f] = sq_bb(rto) ^ sq_bb(rfrom);
   // need 2nd set of from/to, maybe... for undo
-  CastlingRookFrom[kto & 0x0f] = rfrom != kto ? rfrom : rto;
-  CastlingRookTo[kto & 0x0f] = rto;
-  CastlingRookSquare[cr] = rfrom;
+  pos->castlingRookFrom[kto & 0x0f] = rfrom != kto ? rfrom : rto;
+  pos->castlingRookTo[kto & 0x0f] = rto;
+#endif
 
   for (Square s = min(rfrom, rto); s <= max(rfrom, rto); s++)
     if (s != kfrom && s != rfrom)
-      CastlingPath[cr] |= sq_bb(s);
+      pos->castlingPath[cr] |= sq_bb(s);
 
   for (Square s = min(kfrom, kto); s <= max(kfrom, kto); s++)
     if (s != kfrom && s != rfrom)
-      CastlingPath[cr] |= sq_bb(s);
-#endif
+      pos->castlingPath[cr] |= sq_bb(s);
 }
 
 
@@ -749,7 +735,7 @@ int gives_check_special(const Pos *pos, Stack *st, Move m)
     // Castling is encoded as 'King captures the rook'
     Square rto = relative_square(pos_stm(), to > from ? SQ_F1 : SQ_D1);
 #else
-    Square rto = CastlingRookTo[to & 0x0f];
+    Square rto = pos->castlingRookTo[to & 0x0f];
 #endif
     return   (PseudoAttacks[ROOK][rto] & sq_bb(st->ksq))
           && (attacks_bb_rook(rto, pieces() ^ sq_bb(from)) & sq_bb(st->ksq));
@@ -779,8 +765,8 @@ void do_move(Pos *pos, Move m, int givesCheck)
 
   // Update castling rights.
   st->castlingRights =  (st-1)->castlingRights
-                      & CastlingRightsMask[from]
-                      & CastlingRightsMask[to];
+                      & ~(  pos->castlingRightsMask[from]
+                          | pos->castlingRightsMask[to]);
   key ^= zob.castling[st->castlingRights ^ (st-1)->castlingRights];
 
   int capt_piece = pos->board[to];
@@ -851,12 +837,12 @@ void do_move(Pos *pos, Move m, int givesCheck)
         }
       }
     } else if (type_of_m(m) == CASTLING) {
-      key ^= CastlingHash[to & 0x0f];
-      pos->byTypeBB[ROOK] ^= CastlingBits[to & 0x0f];
-      pos->byColorBB[us] ^= CastlingBits[to & 0x0f];
-      pos->board[CastlingRookFrom[to & 0x0f]] = 0;
-      pos->board[CastlingRookTo[to & 0x0f]] = ROOK | (to & 0x08);
-      st->psq += CastlingPSQ[to & 0x0f];
+      key ^= pos->castlingHash[to & 0x0f];
+      pos->byTypeBB[ROOK] ^= pos->castlingBits[to & 0x0f];
+      pos->byColorBB[us] ^= pos->castlingBits[to & 0x0f];
+      pos->board[pos->castlingRookFrom[to & 0x0f]] = 0;
+      pos->board[pos->castlingRookTo[to & 0x0f]] = ROOK | (to & 0x08);
+      st->psq += pos->castlingPSQ[to & 0x0f];
     }
   }
   st->key = key;
@@ -906,10 +892,10 @@ void undo_move(Pos *pos, Move m)
     pos->byColorBB[us ^ 1] ^= sq_bb(to);
   }
   else if (type_of_m(m) == CASTLING) {
-    pos->byTypeBB[ROOK] ^= CastlingBits[to & 0x0f];
-    pos->byColorBB[us] ^= CastlingBits[to & 0x0f];
-    pos->board[CastlingRookTo[to & 0x0f]] = 0;
-    pos->board[CastlingRookFrom[to & 0x0f]] = ROOK | (to & 0x08);
+    pos->byTypeBB[ROOK] ^= pos->castlingBits[to & 0x0f];
+    pos->byColorBB[us] ^= pos->castlingBits[to & 0x0f];
+    pos->board[pos->castlingRookTo[to & 0x0f]] = 0;
+    pos->board[pos->castlingRookFrom[to & 0x0f]] = ROOK | (to & 0x08);
   }
   pos->byTypeBB[0] = pos->byColorBB[0] | pos->byColorBB[1];
 
@@ -1183,7 +1169,7 @@ void do_null_move(Pos *pos)
   }
 
   st->key ^= zob.side;
-  prefetch(tt_first_entry(st->key));
+  prefetch(tt_first_entry(&pos->engine->tt, st->key));
 
   st->rule50++;
   st->pliesFromNull = 0;
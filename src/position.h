@@ -30,6 +30,7 @@
 #include <string.h>
 
 #include "bitboard.h"
+#include "tt.h"
 #include "types.h"
 
 struct Zob {
@@ -87,6 +88,7 @@ struct Stack {
   int skipEarlyPruning;
   int moveCount;
   CounterMoveStats *counterMoves;
+  SplitPoint *splitPoint; // Set while a thread joins the split point here
 
   // MovePicker data
   Move countermove;
@@ -136,23 +138,41 @@ struct Pos {
   uint8_t pieceCount[16];
   uint8_t pieceList[256];
   uint8_t index[64];
+#else
+  // Rook move of a castling, indexed by the king's destination square.
+  Key castlingHash[16];
+  Bitboard castlingBits[16];
+  Score castlingPSQ[16];
+  uint8_t castlingRookFrom[16];
+  uint8_t castlingRookTo[16];
+#endif
   uint8_t castlingRightsMask[64];
   uint8_t castlingRookSquare[16];
   Bitboard castlingPath[16];
-#endif
   uint16_t gamePly;
 
   ExtMove *moveList;
+  Engine *engine; // The engine this thread searches for
 
-  // Relevant mainly to the search of the root position.
+  // Search data private to the thread, hot during the search. The root
+  // depths are also read by other threads, but only once per iteration.
   RootMoves *rootMoves;
   Stack *stack;
-  uint64_t nodes;
-  uint64_t tb_hits;
+  // Triangular PV table. Row ply holds the PV of the PV node at that ply,
+  // no more than MAX_PLY + 1 - ply moves, and is handed to its children as
+  // (ss+1)->pv by their parent. A qsearch() at MAX_PLY still sets up the
+  // row after its own, so there are MAX_PLY + 2 rows.
+  Move (*pvTable)[MAX_PLY + 1];
   int PVIdx;
   int maxPly;
+  SplitPoint *activeSplitPoint; // Innermost split point worked on, or NULL
+  SplitPoint *splitPoints; // Opened by this thread, see split_point_open()
+  int splitPointsSize;
   Depth rootDepth;
   Depth completedDepth;
+#ifdef TT_STATS
+  TTStats ttStats;
+#endif
 
   // Pointers to thread-specific tables.
   HistoryStats *history;
@@ -162,11 +182,19 @@ struct Pos {
   MaterialEntry *materialTable;
   CounterMoveHistoryStats *counterMoveHistory;
 
+  // Counters written by the thread and read by the timer and the main
+  // thread during the search. The padding keeps them off the cache lines
+  // of the data around them, whatever the alignment of the struct.
+  char countersPadding0[CacheLineSize];
+  uint64_t nodes;
+  uint64_t tb_hits;
+  char countersPadding1[CacheLineSize];
+
   // Thread-control data.
-  atomic_bool resetCalls;
-  int callsCnt;
-  int exit, searching;
+  atomic_int exit, searching;
   int thread_idx;
+  atomic_int splitState; // Idle with YBWC (1), recruited (2) or neither (0)
+  _Atomic(SplitPoint *) splitAssigned;
 #ifndef __WIN32__
   pthread_t nativeThread;
   pthread_mutex_t mutex;
@@ -177,6 +205,13 @@ struct Pos {
 #endif
 };
 
+_Static_assert(offsetof(Pos, nodes) >= offsetof(Pos, countersPadding0) + CacheLineSize,
+               "Pos counters share a cache line with private data");
+_Static_assert(offsetof(Pos, tb_hits) + sizeof(uint64_t) - offsetof(Pos, nodes) <= CacheLineSize,
+               "Pos counters do not fit in a cache line");
+_Static_assert(offsetof(Pos, exit) >= offsetof(Pos, tb_hits) + sizeof(uint64_t) + CacheLineSize,
+               "Pos counters share a cache line with control data");
+
 // FEN string input/output
 void pos_set(Pos *pos, char *fen, int isChess960);
 void pos_fen(const Pos *pos, char *fen);
@@ -233,13 +268,8 @@ PURE int is_draw(const Pos *pos);
 // Castling
 #define can_castle_cr(cr) (pos->st->castlingRights & (cr))
 #define can_castle_c(c) can_castle_cr((WHITE_OO | WHITE_OOO) << (2 * (c)))
-#ifdef PEDANTIC
 #define castling_impeded(cr) (pieces() & pos->castlingPath[cr])
 #define castling_rook_square(cr) (pos->castlingRookSquare[cr])
-#else
-#define castling_impeded(cr) (pieces() & CastlingPath[cr])
-#define castling_rook_square(cr) (CastlingRookSquare[cr])
-#endif
 
 // Checking
 #define pos_checkers() (pos->st->checkersBB)
@@ -27,27 +27,26 @@ Value name_NT_InCheck(qsearch)(Pos* pos, Stack* ss, Value alpha, BETA_ARG
   assert(PvNode || (alpha == beta - 1));
   assert(depth <= DEPTH_ZERO);
 
-  Move pv[MAX_PLY+1];
-  TTEntry *tte;
+  TTEntry *tte, ttData;
   Key posKey;
   Move ttMove, move, bestMove;
   Value bestValue, value, ttValue, futilityValue, futilityBase, oldAlpha;
   int ttHit, givesCheck, evasionPrunable;
   Depth ttDepth;
 
+  ss->currentMove = bestMove = 0;
+  ss->ply = (ss-1)->ply + 1;
+
   if (PvNode) {
     oldAlpha = alpha; // To flag BOUND_EXACT when eval above alpha and no available moves
-    (ss+1)->pv = pv;
+    (ss+1)->pv = pos->pvTable[ss->ply + 1];
     ss->pv[0] = 0;
   }
 
-  ss->currentMove = bestMove = 0;
-  ss->ply = (ss-1)->ply + 1;
-
   // Check for an instant draw or if the maximum ply has been reached
   if (is_draw(pos) || ss->ply >= MAX_PLY)
     return ss->ply >= MAX_PLY && !InCheck ? evaluate(pos)
-                                          : DrawValue[pos_stm()];
+                                          : pos->engine->drawValue[pos_stm()];
 
   assert(0 <= ss->ply && ss->ply < MAX_PLY);
 
@@ -59,16 +58,16 @@ Value name_NT_InCheck(qsearch)(Pos* pos, Stack* ss, Value alpha, BETA_ARG
 
   // Transposition table lookup
   posKey = pos_key();
-  tte = tt_probe(posKey, &ttHit);
-  ttMove = ttHit ? tte_move(tte) : 0;
-  ttValue = ttHit ? value_from_tt(tte_value(tte), ss->ply) : VALUE_NONE;
+  tte = tt_probe(&pos->engine->tt, posKey, &ttHit, &ttData);
+  ttMove = ttHit ? tte_move(&ttData) : 0;
+  ttValue = ttHit ? value_from_tt(tte_value(&ttData), ss->ply) : VALUE_NONE;
 
   if (  !PvNode
       && ttHit
-      && tte_depth(tte) >= ttDepth
+      && tte_depth(&ttData) >= ttDepth
       && ttValue != VALUE_NONE // Only in case of TT access race
-      && (ttValue >= beta ? (tte_bound(tte) &  BOUND_LOWER)
-                          : (tte_bound(tte) &  BOUND_UPPER))) {
+      && (ttValue >= beta ? (tte_bound(&ttData) &  BOUND_LOWER)
+                          : (tte_bound(&ttData) &  BOUND_UPPER))) {
     ss->currentMove = ttMove; // Can be 0.
     return ttValue;
   }
@@ -80,12 +79,12 @@ Value name_NT_InCheck(qsearch)(Pos* pos, Stack* ss, Value alpha, BETA_ARG
   } else {
     if (ttHit) {
       // Never assume anything on values stored in TT
-      if ((ss->staticEval = bestValue = tte_eval(tte)) == VALUE_NONE)
+      if ((ss->staticEval = bestValue = tte_eval(&ttData)) == VALUE_NONE)
          ss->staticEval = bestValue = evaluate(pos);
 
       // Can ttValue be used as a better position evaluation?
       if (ttValue != VALUE_NONE)
-        if (tte_bound(tte) & (ttValue > bestValue ? BOUND_LOWER : BOUND_UPPER))
+        if (tte_bound(&ttData) & (ttValue > bestValue ? BOUND_LOWER : BOUND_UPPER))
           bestValue = ttValue;
     } else
       ss->staticEval = bestValue =
@@ -97,7 +96,7 @@ Value name_NT_InCheck(qsearch)(Pos* pos, Stack* ss, Value alpha, BETA_ARG
       if (!ttHit)
         tte_save(tte, posKey, value_to_tt(bestValue, ss->ply),
                  BOUND_LOWER, DEPTH_NONE, 0, ss->staticEval,
-                 tt_generation());
+                 tt_generation(&pos->engine->tt));
 
       return bestValue;
     }
@@ -152,7 +151,7 @@ Value name_NT_InCheck(qsearch)(Pos* pos, Stack* ss, Value alpha, BETA_ARG
       continue;
 
     // Speculative prefetch as early as possible
-    prefetch(tt_first_entry(key_after(pos, move)));
+    prefetch(tt_first_entry(&pos->engine->tt, key_after(pos, move)));
 
     // Check for legality just before making the move
     if (!is_legal(pos, move))
@@ -186,7 +185,7 @@ Value name_NT_InCheck(qsearch)(Pos* pos, Stack* ss, Value alpha, BETA_ARG
           bestMove = move;
         } else { // Fail high
           tte_save(tte, posKey, value_to_tt(value, ss->ply), BOUND_LOWER,
-                   ttDepth, move, ss->staticEval, tt_generation());
+                   ttDepth, move, ss->staticEval, tt_generation(&pos->engine->tt));
 
           return value;
         }
@@ -201,7 +200,7 @@ Value name_NT_InCheck(qsearch)(Pos* pos, Stack* ss, Value alpha, BETA_ARG
 
   tte_save(tte, posKey, value_to_tt(bestValue, ss->ply),
            PvNode && bestValue > oldAlpha ? BOUND_EXACT : BOUND_UPPER,
-           ttDepth, bestMove, ss->staticEval, tt_generation());
+           ttDepth, bestMove, ss->staticEval, tt_generation(&pos->engine->tt));
 
   assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
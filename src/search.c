@@ -24,10 +24,12 @@
 #include <stdio.h>
 #include <inttypes.h>
 
+#include "cluster.h"
 #include "evaluate.h"
 #include "misc.h"
 #include "movegen.h"
 #include "movepick.h"
+#include "engine.h"
 #include "search.h"
 #include "timeman.h"
 #include "thread.h"
@@ -38,15 +40,6 @@
 #define load_rlx(x) atomic_load_explicit(&(x), memory_order_relaxed)
 #define store_rlx(x,y) atomic_store_explicit(&(x), y, memory_order_relaxed)
 
-SignalsType Signals;
-LimitsType Limits;
-
-int TB_Cardinality;
-int TB_RootInTB;
-int TB_UseRule50;
-Depth TB_ProbeDepth;
-Value TB_Score;
-
 // Different node types, used as a template parameter
 
 #define NonPV 0
@@ -84,38 +77,32 @@ struct Skill {
 // Easy move code for detecting an 'easy move'. If the PV is stable across
 // multiple search iterations, we can quickly return the best move.
 
-struct {
-  int stableCnt;
-  Key expectedPosKey;
-  Move pv[3];
-} EM;
-
-static void easy_move_clear(void)
+static void easy_move_clear(struct EasyMove *em)
 {
-  EM.stableCnt = 0;
-  EM.expectedPosKey = 0;
-  EM.pv[0] = EM.pv[1] = EM.pv[2] = 0;
+  em->stableCnt = 0;
+  em->expectedPosKey = 0;
+  em->pv[0] = em->pv[1] = em->pv[2] = 0;
 }
 
-static Move easy_move_get(Key key)
+static Move easy_move_get(struct EasyMove *em, Key key)
 {
-  return EM.expectedPosKey == key ? EM.pv[2] : 0;
+  return em->expectedPosKey == key ? em->pv[2] : 0;
 }
 
-static void easy_move_update(Pos *pos, Move *newPv)
+static void easy_move_update(struct EasyMove *em, Pos *pos, Move *newPv)
 {
 //  assert(newPv.size() >= 3);
 
   // Keep track of how many times in a row the 3rd ply remains stable
-  if (newPv[2] == EM.pv[2])
-    EM.stableCnt++;
+  if (newPv[2] == em->pv[2])
+    em->stableCnt++;
   else
-    EM.stableCnt = 0;
+    em->stableCnt = 0;
 
-  if (newPv[0] != EM.pv[0] || newPv[1] != EM.pv[1] || newPv[2] != EM.pv[2]) {
+  if (newPv[0] != em->pv[0] || newPv[1] != em->pv[1] || newPv[2] != em->pv[2]) {
     do_move(pos, newPv[0], gives_check(pos, pos->st, newPv[0]));
     do_move(pos, newPv[1], gives_check(pos, pos->st, newPv[1]));
-    EM.expectedPosKey = pos_key();
+    em->expectedPosKey = pos_key();
     undo_move(pos, newPv[1]);
     undo_move(pos, newPv[0]);
   }
@@ -156,7 +143,6 @@ static const int HalfDensityRowSize[HalfDensitySize] = {
   8, 8, 8, 8, 8, 8, 8, 8
 };
 
-static Value DrawValue[2];
 //static CounterMoveHistoryStats CounterMoveHistory;
 
 static Value search_PV(Pos *pos, Stack *ss, Value alpha, Value beta, Depth depth);
@@ -172,13 +158,15 @@ static Value value_from_tt(Value v, int ply);
 static void update_pv(Move *pv, Move move, Move *childPv);
 static void update_cm_stats(Stack *ss, Piece pc, Square s, Value bonus);
 static void update_stats(const Pos *pos, Stack *ss, Move move, Move *quiets, int quietsCnt, Value bonus);
-static void check_time(void);
 static void stable_sort(RootMove *rm, size_t num);
-static void uci_print_pv(Pos *pos, Depth depth, Value alpha, Value beta);
+static void report_pv(Pos *pos, Depth depth, Value alpha, Value beta);
+static void split_publish(Pos *pos, size_t multiPV);
+static void split_report(Engine *engine);
+static void report_line(Engine *engine, RootMove *rm, Depth depth,
+                        int multiPV);
+static void split_point_idle_loop(Pos *pos);
 static int extract_ponder_from_tt(RootMove *rm, Pos *pos);
 
-static TimePoint lastInfoTime;
-
 // search_init() is called during startup to initialize various lookup tables
 
 void search_init(void)
@@ -202,29 +190,51 @@ void search_init(void)
     FutilityMoveCounts[0][d] = (int)(2.4 + 0.773 * pow(d + 0.00, 1.8));
     FutilityMoveCounts[1][d] = (int)(2.9 + 1.045 * pow(d + 0.49, 1.8));
   }
-
-  lastInfoTime = now();
 }
 
 
 // search_clear() resets search state to zero, to obtain reproducible results
 
-void search_clear()
+void search_clear(Engine *engine)
 {
-  tt_clear();
+  tt_clear(engine);
 
-  for (int i = 0; i < num_cmh_tables; i++)
-    if (cmh_tables[i])
-      stats_clear(cmh_tables[i]);
+  for (int i = 0; i < engine->threads.num_cmh_tables; i++)
+    if (engine->threads.cmh_tables[i])
+      stats_clear(engine->threads.cmh_tables[i]);
 
-  for (size_t idx = 0; idx < Threads.num_threads; idx++) {
-    Pos *pos = Threads.pos[idx];
+  for (size_t idx = 0; idx < engine->threads.num_threads; idx++) {
+    Pos *pos = engine->threads.pos[idx];
     stats_clear(pos->history);
     stats_clear(pos->counterMoves);
     stats_clear(pos->fromTo);
+#ifdef TT_STATS
+    memset(&pos->ttStats, 0, sizeof(pos->ttStats));
+#endif
   }
 
-  mainThread.previousScore = VALUE_INFINITE;
+  engine->mainThread.previousScore = VALUE_INFINITE;
+}
+
+
+// search_print_latency() prints how late searches with a movetime
+// stopped, how long it took from "go" until all threads were searching and
+// how long from raising signals.stop until the best move was reported.
+
+void search_print_latency(Engine *engine, FILE *F)
+{
+  struct SearchLatency *lat = &engine->latency;
+
+  if (engine->stopLatency.count)
+    fprintf(F, "Stop latency    : %.1fms average, %" PRIu64 "ms max\n",
+               (double)engine->stopLatency.total / engine->stopLatency.count,
+               engine->stopLatency.max);
+  if (lat->goCount)
+    fprintf(F, "Go to search    : %.1fus average, %" PRIu64 "us max\n",
+               (double)lat->goTotal / lat->goCount, lat->goMax);
+  if (lat->stopCount)
+    fprintf(F, "Stop to bestmove: %.1fus average, %" PRIu64 "us max\n",
+               (double)lat->stopTotal / lat->stopCount, lat->stopMax);
 }
 
 
@@ -273,91 +283,142 @@ uint64_t perft(Pos *pos, Depth depth)
 
 // mainthread_search() is called by the main thread when the program
 // receives the UCI 'go' command. It searches from the root position and
-// outputs the "bestmove".
+// reports the best move through the on_bestmove callback.
 
-void mainthread_search(void)
+void mainthread_search(Engine *engine)
 {
-  Pos *pos = Threads.pos[0];
+  Pos *pos = engine->threads.pos[0];
   int us = pos_stm();
-  time_init(&Limits, us, pos_game_ply());
-  char buf[16];
+  time_init(engine, us, pos_game_ply());
+
+  timer_start(engine);
 
   int contempt = option_value(OPT_CONTEMPT) * PawnValueEg / 100; // From centipawns
-  DrawValue[us    ] = VALUE_DRAW - (Value)contempt;
-  DrawValue[us ^ 1] = VALUE_DRAW + (Value)contempt;
+  engine->drawValue[us    ] = VALUE_DRAW - (Value)contempt;
+  engine->drawValue[us ^ 1] = VALUE_DRAW + (Value)contempt;
 
   if (pos->rootMoves->size == 0) {
-    pos->rootMoves->move[pos->rootMoves->size++].pv[0] = 0;
-    IO_LOCK;
-    printf("info depth 0 score %s\n",
-           uci_value(buf, pos_checkers() ? -VALUE_MATE : VALUE_DRAW));
-    fflush(stdout);
-    IO_UNLOCK;
+    root_moves_add(pos->rootMoves, 0);
+    if (engine->callbacks.on_pv) {
+      SearchInfo info = { 0 };
+      info.multiPV = 1;
+      info.score = pos_checkers() ? -VALUE_MATE : VALUE_DRAW;
+      info.bound = BOUND_EXACT;
+      info.hashfull = -1;
+      engine->callbacks.on_pv(engine->callbacks.data, &info);
+    }
   } else {
-    for (size_t idx = 1; idx < Threads.num_threads; idx++)
-      thread_start_searching(Threads.pos[idx], 0);
+    threads_start_searching(engine, 1);
 
     thread_search(pos); // Let's start searching!
   }
 
   // When playing in 'nodes as time' mode, subtract the searched nodes from
   // the available ones before exiting.
-  if (Limits.npmsec)
-      Time.availableNodes += Limits.inc[us] - threads_nodes_searched();
+  if (engine->limits.npmsec)
+      engine->time.availableNodes +=  engine->limits.inc[us]
+                                    - threads_nodes_searched(engine);
+
+  // With split MultiPV the helpers search root moves of their own, so
+  // they must reach the maximum depth as well.
+  if (engine->split.active)
+    for (size_t idx = 1; idx < engine->threads.num_threads; idx++)
+      thread_wait_for_search_finished(engine->threads.pos[idx]);
 
   // When we reach the maximum depth, we can arrive here without a raise
-  // of Signals.stop. However, if we are pondering or in an infinite
+  // of signals.stop. However, if we are pondering or in an infinite
   // search, the UCI protocol states that we shouldn't print the best
   // move before the GUI sends a "stop" or "ponderhit" command. We
   // therefore simply wait here until the GUI sends one of those commands
-  // (which also raises Signals.stop).
-  LOCK(Signals.lock);
-  if (!Signals.stop && (Limits.ponder || Limits.infinite)) {
-    Signals.sleeping = 1;
-    UNLOCK(Signals.lock);
-    thread_wait(pos, &Signals.stop);
+  // (which also raises signals.stop).
+  LOCK(engine->signals.lock);
+  if (!engine->signals.stop && (engine->limits.ponder || engine->limits.infinite)) {
+    engine->signals.sleeping = 1;
+    UNLOCK(engine->signals.lock);
+    thread_wait(pos, &engine->signals.stop);
   } else
-    UNLOCK(Signals.lock);
+    UNLOCK(engine->signals.lock);
 
   // Stop the threads if not already stopped
-  Signals.stop = 1;
+  signal_stop(engine);
 
   // Wait until all threads have finished
-  for (size_t idx = 1; idx < Threads.num_threads; idx++)
-    thread_wait_for_search_finished(Threads.pos[idx]);
+  for (size_t idx = 1; idx < engine->threads.num_threads; idx++)
+    thread_wait_for_search_finished(engine->threads.pos[idx]);
+
+  timer_stop(engine);
+  cluster_stop(engine);
+
+  if (   engine->limits.movetime
+      && time_elapsed(engine) >= engine->limits.movetime) {
+    TimePoint overrun = time_elapsed(engine) - engine->limits.movetime;
+    engine->stopLatency.total += overrun;
+    engine->stopLatency.max = max(engine->stopLatency.max, overrun);
+    engine->stopLatency.count++;
+  }
+
+  struct SearchLatency *lat = &engine->latency;
+  if (lat->numStarted == (int)engine->threads.num_threads) {
+    uint64_t t = lat->startedTime - lat->goTime;
+    lat->goTotal += t;
+    lat->goMax = max(lat->goMax, t);
+    lat->goCount++;
+  }
 
   // Check if there are threads with a better score than main thread
   Pos *bestThread = pos;
-  if (   !mainThread.easyMovePlayed
-      &&  option_value(OPT_MULTI_PV) == 1
-      && !Limits.depth
-//      && !Skill(option_value(OPT_SKILL_LEVEL)).enabled()
-      &&  pos->rootMoves->move[0].pv[0] != 0)
-  {
-    for (size_t idx = 1; idx < Threads.num_threads; idx++) {
-      Pos *p = Threads.pos[idx];
+  int pickBest =  !engine->mainThread.easyMovePlayed
+                &&  option_value(OPT_MULTI_PV) == 1
+                && !engine->limits.depth
+//                && !Skill(option_value(OPT_SKILL_LEVEL)).enabled()
+                &&  pos->rootMoves->move[0].pv[0] != 0;
+  if (pickBest) {
+    for (size_t idx = 1; idx < engine->threads.num_threads; idx++) {
+      Pos *p = engine->threads.pos[idx];
       if (   p->completedDepth > bestThread->completedDepth
           && p->rootMoves->move[0].score > bestThread->rootMoves->move[0].score)
         bestThread = p;
     }
   }
 
-  mainThread.previousScore = bestThread->rootMoves->move[0].score;
+  RootMove *rm = &bestThread->rootMoves->move[0];
 
-  IO_LOCK;
   // Send new PV when needed
   if (bestThread != pos)
-    uci_print_pv(bestThread, bestThread->completedDepth,
-                 -VALUE_INFINITE, VALUE_INFINITE);
+    report_pv(bestThread, bestThread->completedDepth,
+              -VALUE_INFINITE, VALUE_INFINITE);
+
+  // The best line of a split MultiPV search may come from any thread
+  if (   engine->split.active
+      && pos->rootMoves->move[0].pv[0]
+      && engine->split.version > 0) {
+    if (engine->split.version != engine->split.reported)
+      split_report(engine);
+    rm = &engine->split.merged.move[0];
+  }
+
+  // Or from one of the worker processes of a cluster
+  if (pickBest && engine->cluster) {
+    Depth depth = bestThread->completedDepth;
+    RootMove *best = cluster_best(engine, &depth, rm->score);
+    if (best) {
+      rm = best;
+      report_line(engine, rm, depth, 1);
+    }
+  }
 
-  printf("bestmove %s", uci_move(buf, bestThread->rootMoves->move[0].pv[0], is_chess960()));
+  engine->mainThread.previousScore = rm->score;
+  Move ponder = 0;
+  if (rm->pv[0] && (rm->pv_size > 1 || extract_ponder_from_tt(rm, pos)))
+    ponder = rm->pv[1];
 
-  if (bestThread->rootMoves->move[0].pv_size > 1 || extract_ponder_from_tt(&bestThread->rootMoves->move[0], pos))
-    printf(" ponder %s", uci_move(buf, bestThread->rootMoves->move[0].pv[1], is_chess960()));
+  uint64_t t = now_us() - lat->stopTime;
+  lat->stopTotal += t;
+  lat->stopMax = max(lat->stopMax, t);
+  lat->stopCount++;
 
-  printf("\n");
-  fflush(stdout);
-  IO_UNLOCK;
+  if (engine->callbacks.on_bestmove)
+    engine->callbacks.on_bestmove(engine->callbacks.data, rm->pv[0], ponder);
 }
 
 
@@ -368,9 +429,31 @@ void mainthread_search(void)
 
 void thread_search(Pos *pos)
 {
+  Engine *engine = pos->engine;
+  struct EasyMove *em = &engine->em;
   Value bestValue, alpha, beta, delta;
   Move easyMove = 0;
 
+  // Threads searching independent roots for analyse() all behave like
+  // helper threads that do not skip any depth.
+  int isMain = pos->thread_idx == 0 && !engine->threads.independent;
+  int split = engine->split.active && !engine->threads.independent;
+  int schedule =  split || engine->threads.independent ? -1
+                : !isMain ? option_value(OPT_HELPER_SCHEDULE)
+                : engine->clusterIdx ? SCHEDULE_MATRIX : -1;
+  Pos *depthPos =  engine->threads.independent || split ? pos
+                 : threads_main(engine);
+
+  // The last thread to get here tells how long it took to start them all.
+  if (   !engine->threads.independent
+      &&  atomic_fetch_add(&engine->latency.numStarted, 1) + 1
+                                       == (int)engine->threads.num_threads)
+    engine->latency.startedTime = now_us();
+
+  // A thread may have no root moves of its own with split MultiPV.
+  if (split && !pos->rootMoves->size)
+    return;
+
   Stack *ss = pos->st; // The fifth element of the allocated array.
   for (int i = -5; i < 3; i++)
     memset(SStackBegin(ss[i]), 0, SStackSize);
@@ -379,13 +462,22 @@ void thread_search(Pos *pos)
   bestValue = delta = alpha = -VALUE_INFINITE;
   beta = VALUE_INFINITE;
   pos->completedDepth = DEPTH_ZERO;
+  pos->activeSplitPoint = NULL;
+  pos->splitPointsSize = 0;
 
-  if (pos->thread_idx == 0) {
-    easyMove = easy_move_get(pos_key());
-    easy_move_clear();
-    mainThread.easyMovePlayed = mainThread.failedLow = 0;
-    mainThread.bestMoveChanges = 0;
-    tt_new_search();
+  if (   !isMain
+      && !engine->threads.independent
+      &&  engine->ybwc.splitDepth < DEPTH_MAX) {
+    split_point_idle_loop(pos);
+    return;
+  }
+
+  if (isMain) {
+    easyMove = split ? 0 : easy_move_get(em, pos_key());
+    easy_move_clear(em);
+    engine->mainThread.easyMovePlayed = engine->mainThread.failedLow = 0;
+    engine->mainThread.bestMoveChanges = 0;
+    tt_new_search(&engine->tt);
   }
 
   size_t multiPV = option_value(OPT_MULTI_PV);
@@ -404,23 +496,34 @@ void thread_search(Pos *pos)
   // Iterative deepening loop until requested to stop or the target depth
   // is reached.
   while (   (pos->rootDepth += ONE_PLY) < DEPTH_MAX
-         && !Signals.stop
-         && (!Limits.depth || threads_main()->rootDepth <= Limits.depth))
+         && !engine->signals.stop
+         && (   !engine->limits.depth
+             || depthPos->rootDepth <= engine->limits.depth))
   {
     // Set up the new depths for the helper threads skipping on average every
     // 2nd ply (using a half-density matrix).
-    if (pos->thread_idx != 0) {
-      int row = (pos->thread_idx - 1) % HalfDensitySize;
+    // In a worker process of a cluster the main thread skips depths too,
+    // and the rows follow on from the threads of the processes before it.
+    if (schedule == SCHEDULE_MATRIX) {
+      int row = (  engine->clusterIdx * (int)engine->threads.num_threads
+                 + pos->thread_idx - 1) % HalfDensitySize;
       int col = (pos->rootDepth / ONE_PLY + pos_game_ply())
                                                % HalfDensityRowSize[row];
       if (HalfDensity[row][col])
         continue;
     }
 
+    // Or keep 1 + lsb(idx) plies ahead of the main thread, so that half of
+    // the helpers search one ply ahead, a quarter two plies, and so on.
+    if (   schedule == SCHEDULE_OFFSET
+        && pos->rootDepth <  depthPos->rootDepth
+                           + (1 + lsb(pos->thread_idx)) * ONE_PLY)
+      continue;
+
     // Age out PV variability metric
-    if (pos->thread_idx == 0) {
-      mainThread.bestMoveChanges *= 0.505;
-      mainThread.failedLow = 0;
+    if (isMain) {
+      engine->mainThread.bestMoveChanges *= 0.505;
+      engine->mainThread.failedLow = 0;
     }
 
     // Save the last iteration's scores before first PV line is searched and
@@ -428,8 +531,22 @@ void thread_search(Pos *pos)
     for (size_t idx = 0; idx < rootMoves->size; idx++)
       rootMoves->move[idx].previousScore = rootMoves->move[idx].score;
 
+    // Or bring root move idx % size to the front, where it is searched
+    // first, with the aspiration window of the best move so far.
+    if (   schedule == SCHEDULE_PARTITION
+        && multiPV == 1
+        && rootMoves->size > 1) {
+      size_t p = pos->thread_idx % rootMoves->size;
+      if (p > 0) {
+        RootMove rm = rootMoves->move[p];
+        rm.previousScore = rootMoves->move[0].previousScore;
+        memmove(&rootMoves->move[1], &rootMoves->move[0], p * sizeof(RootMove));
+        rootMoves->move[0] = rm;
+      }
+    }
+
     // MultiPV loop. We perform a full root search for each PV line
-    for (size_t PVIdx = 0; PVIdx < multiPV && !Signals.stop; ++PVIdx) {
+    for (size_t PVIdx = 0; PVIdx < multiPV && !engine->signals.stop; ++PVIdx) {
       pos->PVIdx = PVIdx;
       // Reset aspiration window starting size
       if (pos->rootDepth >= 5 * ONE_PLY) {
@@ -455,20 +572,17 @@ void thread_search(Pos *pos)
         // If search has been stopped, break immediately. Sorting and
         // writing PV back to TT is safe because RootMoves is still
         // valid, although it refers to the previous iteration.
-        if (Signals.stop)
+        if (engine->signals.stop)
           break;
 
         // When failing high/low give some update (without cluttering
         // the UI) before a re-search.
-        if (   pos->thread_idx == 0
+        if (   isMain
             && multiPV == 1
+            && !split
             && (bestValue <= alpha || bestValue >= beta)
-            && time_elapsed() > 3000)
-        {
-          IO_LOCK;
-          uci_print_pv(pos, pos->rootDepth, alpha, beta);
-          IO_UNLOCK;
-        }
+            && time_elapsed(engine) > 3000)
+          report_pv(pos, pos->rootDepth, alpha, beta);
 
         // In case of failing low/high increase aspiration window and
         // re-search, otherwise exit the loop.
@@ -476,9 +590,9 @@ void thread_search(Pos *pos)
           beta = (alpha + beta) / 2;
           alpha = max(bestValue - delta, -VALUE_INFINITE);
 
-          if (pos->thread_idx == 0) {
-            mainThread.failedLow = 1;
-            Signals.stopOnPonderhit = 0;
+          if (isMain) {
+            engine->mainThread.failedLow = 1;
+            engine->signals.stopOnPonderhit = 0;
           }
         } else if (bestValue >= beta) {
           alpha = (alpha + beta) / 2;
@@ -494,30 +608,32 @@ void thread_search(Pos *pos)
       // Sort the PV lines searched so far and update the GUI
       stable_sort(&rootMoves->move[0], PVIdx + 1);
 
-      if (pos->thread_idx != 0)
+      if (!isMain)
         continue;
 
-      if (Signals.stop) {
-        IO_LOCK;
-        printf("info nodes %"PRIu64" time %d\n",
-                         threads_nodes_searched(), time_elapsed());
-        fflush(stdout);
-        IO_UNLOCK;
+      if (engine->signals.stop) {
+        if (engine->callbacks.on_nodes)
+          engine->callbacks.on_nodes(engine->callbacks.data,
+                                     threads_nodes_searched(engine),
+                                     time_elapsed(engine));
       }
 
-      else if (PVIdx + 1 == multiPV || time_elapsed() > 3000) {
-        IO_LOCK;
-        uci_print_pv(pos, pos->rootDepth, alpha, beta);
-        IO_UNLOCK;
-      }
+      else if (!split && (PVIdx + 1 == multiPV || time_elapsed(engine) > 3000))
+        report_pv(pos, pos->rootDepth, alpha, beta);
     }
 
-    if (!Signals.stop)
+    if (!engine->signals.stop) {
       pos->completedDepth = pos->rootDepth;
+      if (split)
+        split_publish(pos, multiPV);
+    }
 
-    if (pos->thread_idx != 0)
+    if (!isMain)
       continue;
 
+    if (split && !engine->signals.stop)
+      split_report(engine);
+
 #if 0
     // If skill level is enabled and time is up, pick a sub-optimal best move
     if (skill.enabled() && skill.time_to_pick(thread->rootDepth))
@@ -525,53 +641,54 @@ void thread_search(Pos *pos)
 #endif
 
     // Have we found a "mate in x"?
-    if (   Limits.mate
+    if (   engine->limits.mate
         && bestValue >= VALUE_MATE_IN_MAX_PLY
-        && VALUE_MATE - bestValue <= 2 * Limits.mate)
-      Signals.stop = 1;
+        && VALUE_MATE - bestValue <= 2 * engine->limits.mate)
+      signal_stop(engine);
 
     // Do we have time for the next iteration? Can we stop searching now?
-    if (use_time_management(&Limits)) {
-      if (!Signals.stop && !Signals.stopOnPonderhit) {
+    if (use_time_management(&engine->limits)) {
+      if (!engine->signals.stop && !engine->signals.stopOnPonderhit) {
         // Stop the search if only one legal move is available, or if all
         // of the available time has been used, or if we matched an easyMove
         // from the previous search and just did a fast verification.
-        const int F[] = { mainThread.failedLow,
-                          bestValue - mainThread.previousScore };
+        const int F[] = { engine->mainThread.failedLow,
+                          bestValue - engine->mainThread.previousScore };
 
         int improvingFactor = max(229, min(715, 357 + 119 * F[0] - 6 * F[1]));
-        double unstablePvFactor = 1 + mainThread.bestMoveChanges;
+        double unstablePvFactor = 1 + engine->mainThread.bestMoveChanges;
 
         int doEasyMove =   rootMoves->move[0].pv[0] == easyMove
-                         && mainThread.bestMoveChanges < 0.03
-                         && time_elapsed() > time_optimum() * 5 / 42;
+                         && engine->mainThread.bestMoveChanges < 0.03
+                         && time_elapsed(engine) > time_optimum(engine) * 5 / 42;
 
         if (   rootMoves->size == 1
-            || time_elapsed() > time_optimum() * unstablePvFactor * improvingFactor / 628
-            || (mainThread.easyMovePlayed = doEasyMove)) {
+            ||   time_elapsed(engine)
+               > time_optimum(engine) * unstablePvFactor * improvingFactor / 628
+            || (engine->mainThread.easyMovePlayed = doEasyMove)) {
           // If we are allowed to ponder do not stop the search now but
           // keep pondering until the GUI sends "ponderhit" or "stop".
-          if (Limits.ponder)
-            Signals.stopOnPonderhit = 1;
+          if (engine->limits.ponder)
+            engine->signals.stopOnPonderhit = 1;
           else
-            Signals.stop = 1;
+            signal_stop(engine);
         }
       }
 
       if (rootMoves->move[0].pv_size >= 3)
-        easy_move_update(pos, rootMoves->move[0].pv);
+        easy_move_update(em, pos, rootMoves->move[0].pv);
       else
-        easy_move_clear();
+        easy_move_clear(em);
     }
   }
 
-  if (pos->thread_idx != 0)
+  if (!isMain)
     return;
 
   // Clear any candidate easy move that wasn't stable for the last search
   // iterations; the second condition prevents consecutive fast moves.
-  if (EM.stableCnt < 6 || mainThread.easyMovePlayed)
-    easy_move_clear();
+  if (em->stableCnt < 6 || engine->mainThread.easyMovePlayed)
+    easy_move_clear(em);
 
 #if 0
   // If skill level is enabled, swap best PV line with the sub-optimal one
@@ -581,6 +698,126 @@ void thread_search(Pos *pos)
 #endif
 }
 
+// split_point_open() is called by a thread that has searched the first
+// move of a node. It moves the remaining moves of the move picker into a
+// new split point and hands it to as many idle helpers as there are moves.
+// The caller then searches the split point itself and closes it.
+
+static SplitPoint *split_point_open(Pos *pos, Value alpha, Value beta,
+                                    Value bestValue, Move bestMove,
+                                    int moveCount, Depth depth,
+                                    int pvNode, int cutNode)
+{
+  Engine *engine = pos->engine;
+  SplitPoint *sp = &pos->splitPoints[pos->splitPointsSize++];
+  Move move;
+
+  sp->parent = pos->activeSplitPoint;
+  sp->depth = depth;
+  sp->beta = beta;
+  sp->pvNode = pvNode;
+  sp->cutNode = cutNode;
+  sp->alpha = alpha;
+  sp->bestValue = bestValue;
+  sp->bestMove = bestMove;
+  sp->moveCount = moveCount;
+  sp->numMoves = 0;
+  while ((move = next_move(pos)))
+    sp->moves[sp->numMoves++] = move;
+  atomic_store(&sp->nextMove, 0);
+  atomic_store(&sp->cutoff, 0);
+  atomic_store(&sp->workers, 0);
+  pos->activeSplitPoint = sp;
+
+  int recruits = sp->numMoves - 1;
+  for (size_t idx = 0; recruits > 0 && idx < engine->threads.num_threads; idx++)
+  {
+    Pos *helper = engine->threads.pos[idx];
+    int expected = 1;
+    if (   helper == pos
+        || atomic_load_explicit(&helper->splitState, memory_order_relaxed) != 1
+        || !atomic_compare_exchange_strong(&helper->splitState, &expected, 2))
+      continue;
+    atomic_fetch_sub(&engine->ybwc.idle, 1);
+
+    // The helper gets the board and the stack entries around the node.
+    // Older positions, needed for repetitions, are reached through the
+    // previous pointers and do not change while the split point is open.
+    memcpy(helper, pos, offsetof(Pos, moveList));
+    helper->st = helper->stack + (pos->st - pos->stack);
+    memcpy(helper->st - 5, pos->st - 5, 8 * sizeof(Stack));
+    helper->st->endMoves = (helper->st-1)->endMoves = helper->moveList;
+
+    atomic_fetch_add(&sp->workers, 1);
+    atomic_store_explicit(&helper->splitAssigned, sp, memory_order_release);
+    recruits--;
+  }
+
+  return sp;
+}
+
+// split_point_close() waits until the helpers of a split point are done.
+
+static void split_point_close(Pos *pos, SplitPoint *sp)
+{
+  while (atomic_load_explicit(&sp->workers, memory_order_acquire))
+    thread_yield();
+
+  pos->activeSplitPoint = sp->parent;
+  pos->splitPointsSize--;
+}
+
+// split_point_next_move() returns the next move of a split point to search,
+// or 0 if there is none left or the split point has failed high.
+
+INLINE Move split_point_next_move(SplitPoint *sp)
+{
+  if (atomic_load_explicit(&sp->cutoff, memory_order_relaxed))
+    return 0;
+  int i = atomic_fetch_add_explicit(&sp->nextMove, 1, memory_order_relaxed);
+  return i < sp->numMoves ? sp->moves[i] : 0;
+}
+
+// split_point_idle_loop() is where the helpers wait with YBWC until they
+// are recruited by split_point_open(). They leave when the search stops.
+
+static void split_point_idle_loop(Pos *pos)
+{
+  Engine *engine = pos->engine;
+
+  atomic_store(&pos->splitState, 1);
+  atomic_fetch_add(&engine->ybwc.idle, 1);
+
+  while (1) {
+    SplitPoint *sp = atomic_load_explicit(&pos->splitAssigned,
+                                          memory_order_acquire);
+    if (sp) {
+      pos->activeSplitPoint = sp;
+      pos->st->splitPoint = sp;
+      if (sp->pvNode)
+        search_PV(pos, pos->st, sp->alpha, sp->beta, sp->depth);
+      else
+        search_NonPV(pos, pos->st, sp->alpha, sp->depth, sp->cutNode);
+      pos->activeSplitPoint = NULL;
+
+      atomic_store(&pos->splitAssigned, NULL);
+      atomic_fetch_sub_explicit(&sp->workers, 1, memory_order_release);
+      atomic_store(&pos->splitState, 1);
+      atomic_fetch_add(&engine->ybwc.idle, 1);
+      continue;
+    }
+
+    // A helper that has just been recruited must still join.
+    int expected = 1;
+    if (   load_rlx(engine->signals.stop)
+        && atomic_compare_exchange_strong(&pos->splitState, &expected, 0)) {
+      atomic_fetch_sub(&engine->ybwc.idle, 1);
+      break;
+    }
+    thread_yield();
+  }
+}
+
 // search_PV() is the main search function for PV nodes.
 #define NT PV
 #include "ntsearch.c"
@@ -752,42 +989,148 @@ void update_stats(const Pos *pos, Stack *ss, Move move, Move *quiets,
 #endif
 
 
-// check_time() is used to print debug info and, more importantly, to detect
+// check_time() is called by the timer thread every millisecond during a
+// search. It is used to print debug info and, more importantly, to detect
 // when we are out of available time and thus stop the search.
 
-static void check_time(void)
+void check_time(Engine *engine)
 {
-  int elapsed = time_elapsed();
-  TimePoint tick = Limits.startTime + elapsed;
+  int elapsed = time_elapsed(engine);
+  TimePoint tick = engine->limits.startTime + elapsed;
 
-  if (tick - lastInfoTime >= 1000) {
-    lastInfoTime = tick;
+  if (tick - engine->lastInfoTime >= 1000) {
+    engine->lastInfoTime = tick;
     dbg_print();
   }
 
   // An engine may not stop pondering until told so by the GUI
-  if (Limits.ponder)
+  if (engine->limits.ponder)
     return;
 
-  if (   (use_time_management(&Limits) && elapsed > time_maximum() - 10)
-      || (Limits.movetime && elapsed >= Limits.movetime)
-      || (Limits.nodes && threads_nodes_searched() >= Limits.nodes))
-        Signals.stop = 1;
+  LimitsType *limits = &engine->limits;
+
+  if (   (use_time_management(limits) && elapsed > time_maximum(engine) - 10)
+      || (limits->movetime && elapsed >= limits->movetime)
+      || (limits->nodes && threads_nodes_searched(engine) >= limits->nodes))
+        signal_stop(engine);
+
+  if (engine->cluster)
+    cluster_poll(engine);
 }
 
-// uci_print_pv() prints PV information according to the UCI protocol.
-// UCI requires that all (if any) unsearched PV lines are sent with a
-// previous search score.
+// split_publish() stores the lines a thread found in its last completed
+// iteration of a split MultiPV search. Its other root moves are known to
+// be worse than its last line and are published without a score.
 
-static void uci_print_pv(Pos *pos, Depth depth, Value alpha, Value beta)
+static void split_publish(Pos *pos, size_t multiPV)
 {
-  int elapsed = time_elapsed() + 1;
+  struct SplitPV *sp = &pos->engine->split;
+  RootMoves *rootMoves = pos->rootMoves;
+
+  LOCK(sp->lock);
+  for (size_t i = 0; i < rootMoves->size; i++)
+    for (size_t j = 0; j < sp->moves.size; j++) {
+      RootMove *rm = &sp->moves.move[j];
+      if (rm->pv[0] != rootMoves->move[i].pv[0])
+        continue;
+      if (i < multiPV)
+        root_move_copy(rm, &rootMoves->move[i]);
+      else {
+        rm->score = -VALUE_INFINITE;
+        rm->pv_size = 1;
+      }
+      sp->depth[j] = pos->rootDepth;
+      break;
+    }
+  sp->version++;
+  UNLOCK(sp->lock);
+}
+
+// split_report() merges the published lines into the best MultiPV lines
+// overall and passes them to the on_pv callback, each with the depth it
+// was searched to.
+
+static void split_report(Engine *engine)
+{
+  struct SplitPV *sp = &engine->split;
+  RootMoves *merged = &sp->merged;
+  size_t multiPV = min((size_t)option_value(OPT_MULTI_PV), sp->moves.size);
+  int taken[MAX_MOVES] = { 0 };
+
+  LOCK(sp->lock);
+  for (merged->size = 0; merged->size < multiPV; merged->size++) {
+    size_t best = 0;
+    Value bestScore = -VALUE_INFINITE - 1;
+    for (size_t j = 0; j < sp->moves.size; j++)
+      if (!taken[j] && sp->moves.move[j].score > bestScore) {
+        best = j;
+        bestScore = sp->moves.move[j].score;
+      }
+    taken[best] = 1;
+    merged->move[merged->size].pv = merged->pvTable[merged->size];
+    root_move_copy(&merged->move[merged->size], &sp->moves.move[best]);
+    sp->mergedDepth[merged->size] = sp->depth[best];
+  }
+  sp->reported = sp->version;
+  UNLOCK(sp->lock);
+
+  for (size_t i = 0; i < merged->size; i++)
+    if (sp->mergedDepth[i] != DEPTH_ZERO)
+      report_line(engine, &merged->move[i], sp->mergedDepth[i], (int)i + 1);
+}
+
+// report_line() passes a single exact line, searched to the given depth by
+// any thread or process, to the on_pv callback.
+
+static void report_line(Engine *engine, RootMove *rm, Depth depth,
+                        int multiPV)
+{
+  if (!engine->callbacks.on_pv)
+    return;
+
+  int elapsed = time_elapsed(engine) + 1;
+  Value v = rm->score;
+  int tb = engine->tbRootInTB && abs(v) < VALUE_MATE - MAX_PLY;
+  SearchInfo info;
+
+  info.depth = depth / ONE_PLY;
+  info.selDepth = threads_main(engine)->maxPly;
+  info.multiPV = multiPV;
+  info.score = tb ? engine->tbScore : v;
+  info.bound = BOUND_EXACT;
+  info.tbScore = tb;
+  info.nodes = threads_nodes_searched(engine);
+  info.nps = info.nodes * 1000 / elapsed;
+  info.tbHits = threads_tb_hits(engine);
+  info.time = elapsed;
+  info.hashfull = elapsed > 1000 ? tt_hashfull(&engine->tt) : -1;
+  info.pvSize = rm->pv_size;
+  info.pv = rm->pv;
+
+  engine->callbacks.on_pv(engine->callbacks.data, &info);
+}
+
+// report_pv() passes the PV lines to the on_pv callback. Lines not yet
+// searched in this iteration are reported with their previous score.
+
+static void report_pv(Pos *pos, Depth depth, Value alpha, Value beta)
+{
+  Engine *engine = pos->engine;
+  if (!engine->callbacks.on_pv)
+    return;
+
+  int elapsed = time_elapsed(engine) + 1;
   RootMoves *rootMoves = pos->rootMoves;
   size_t PVIdx = pos->PVIdx;
   size_t multiPV = min((size_t)option_value(OPT_MULTI_PV), rootMoves->size);
-  uint64_t nodes_searched = threads_nodes_searched();
-  uint64_t tbhits = threads_tb_hits();
-  char buf[16];
+  SearchInfo info;
+
+  info.selDepth = pos->maxPly;
+  info.nodes = threads_nodes_searched(engine);
+  info.nps = info.nodes * 1000 / elapsed;
+  info.tbHits = threads_tb_hits(engine);
+  info.time = elapsed;
+  info.hashfull = elapsed > 1000 ? tt_hashfull(&engine->tt) : -1;
 
   for (size_t i = 0; i < multiPV; ++i) {
     int updated = (i <= PVIdx);
@@ -799,28 +1142,21 @@ static void uci_print_pv(Pos *pos, Depth depth, Value alpha, Value beta)
     Value v = updated ? rootMoves->move[i].score
                       : rootMoves->move[i].previousScore;
 
-    int tb = TB_RootInTB && abs(v) < VALUE_MATE - MAX_PLY;
-    v = tb ? TB_Score : v;
-
-    printf("info depth %d seldepth %d multipv %d score %s",
-           d / ONE_PLY, pos->maxPly, (int)i + 1, uci_value(buf, v));
-
-    if (!tb && i == PVIdx)
-      printf("%s", v >= beta ? " lowerbound" : v <= alpha ? " upperbound" : "");
-
-    printf(" nodes %"PRIu64" nps %"PRIu64, nodes_searched,
-                              nodes_searched * 1000 / elapsed);
-
-    if (elapsed > 1000)
-      printf(" hashfull %d", tt_hashfull());
+    int tb = engine->tbRootInTB && abs(v) < VALUE_MATE - MAX_PLY;
+    v = tb ? engine->tbScore : v;
 
-    printf(" tbhits %"PRIu64" time %d pv", tbhits, elapsed);
+    info.depth = d / ONE_PLY;
+    info.multiPV = (int)i + 1;
+    info.score = v;
+    info.tbScore = tb;
+    info.bound =  tb || i != PVIdx ? BOUND_EXACT
+                : v >= beta ? BOUND_LOWER
+                : v <= alpha ? BOUND_UPPER : BOUND_EXACT;
+    info.pvSize = rootMoves->move[i].pv_size;
+    info.pv = rootMoves->move[i].pv;
 
-    for (size_t idx = 0; idx < rootMoves->move[i].pv_size; idx++)
-      printf(" %s", uci_move(buf, rootMoves->move[i].pv[idx], is_chess960()));
-    printf("\n");
+    engine->callbacks.on_pv(engine->callbacks.data, &info);
   }
-  fflush(stdout);
 }
 
 
@@ -833,14 +1169,15 @@ static void uci_print_pv(Pos *pos, Depth depth, Value alpha, Value beta)
 static int extract_ponder_from_tt(RootMove *rm, Pos *pos)
 {
   int ttHit;
+  TTEntry ttData;
 
   assert(rm->pv_size == 1);
 
   do_move(pos, rm->pv[0], gives_check(pos, pos->st, rm->pv[0]));
-  TTEntry *tte = tt_probe(pos_key(), &ttHit);
+  tt_probe(&pos->engine->tt, pos_key(), &ttHit, &ttData);
 
   if (ttHit) {
-    Move m = tte_move(tte); // Local copy to be SMP safe
+    Move m = tte_move(&ttData);
     ExtMove list[MAX_MOVES];
     ExtMove *last = generate_legal(pos, list);
     for (ExtMove *p = list; p < last; p++)
@@ -854,45 +1191,46 @@ static int extract_ponder_from_tt(RootMove *rm, Pos *pos)
   return rm->pv_size > 1;
 }
 
-ExtMove *TB_filter_root_moves(Pos *pos, ExtMove *begin, ExtMove *last)
+ExtMove *TB_filter_root_moves(Engine *engine, Pos *pos, ExtMove *begin,
+                              ExtMove *last)
 {
-  TB_RootInTB = 0;
-  TB_UseRule50 = option_value(OPT_SYZ_50_MOVE);
-  TB_ProbeDepth = option_value(OPT_SYZ_PROBE_DEPTH) * ONE_PLY;
-  TB_Cardinality = option_value(OPT_SYZ_PROBE_LIMIT);
-
-  // Skip TB probing when no TB found: !TBLargest -> !TB_Cardinality
-  if (TB_Cardinality > TB_MaxCardinality) {
-    TB_Cardinality = TB_MaxCardinality;
-    TB_ProbeDepth = DEPTH_ZERO;
+  engine->tbRootInTB = 0;
+  engine->tbUseRule50 = option_value(OPT_SYZ_50_MOVE);
+  engine->tbProbeDepth = option_value(OPT_SYZ_PROBE_DEPTH) * ONE_PLY;
+  engine->tbCardinality = option_value(OPT_SYZ_PROBE_LIMIT);
+
+  // Skip TB probing when no TB found: !TBLargest -> !tbCardinality
+  if (engine->tbCardinality > TB_MaxCardinality) {
+    engine->tbCardinality = TB_MaxCardinality;
+    engine->tbProbeDepth = DEPTH_ZERO;
   }
 
-  if (TB_Cardinality < popcount(pieces()) || can_castle_cr(ANY_CASTLING))
+  if (engine->tbCardinality < popcount(pieces()) || can_castle_cr(ANY_CASTLING))
     return last;
 
   size_t num_moves = last - begin;
 
   // If the current root position is in the tablebases, then RootMoves
   // contains only moves that preserve the draw or the win.
-  TB_RootInTB = TB_root_probe(pos, begin, &num_moves, &TB_Score);
+  engine->tbRootInTB = TB_root_probe(pos, begin, &num_moves, &engine->tbScore);
 
-  if (TB_RootInTB)
-    TB_Cardinality = 0; // Do not probe tablebases during the search.
+  if (engine->tbRootInTB)
+    engine->tbCardinality = 0; // Do not probe tablebases during the search.
 
   else { // If DTZ tables are missing, use WDL tables as a fallback.
     // Filter out moves that do not preserve the draw or the win.
-    TB_RootInTB = TB_root_probe_wdl(pos, begin, &num_moves, &TB_Score);
+    engine->tbRootInTB = TB_root_probe_wdl(pos, begin, &num_moves, &engine->tbScore);
 
     // Only probe during search if winning.
-    if (TB_RootInTB && TB_Score <= VALUE_DRAW)
-      TB_Cardinality = 0;
+    if (engine->tbRootInTB && engine->tbScore <= VALUE_DRAW)
+      engine->tbCardinality = 0;
   }
 
-  if (TB_RootInTB) {
-    if (!TB_UseRule50)
-      TB_Score =  TB_Score > VALUE_DRAW ?  VALUE_MATE - MAX_PLY - 1
-                : TB_Score < VALUE_DRAW ? -VALUE_MATE + MAX_PLY + 1
-                                        :  VALUE_DRAW;
+  if (engine->tbRootInTB) {
+    if (!engine->tbUseRule50)
+      engine->tbScore =  engine->tbScore > VALUE_DRAW ?  VALUE_MATE - MAX_PLY - 1
+                       : engine->tbScore < VALUE_DRAW ? -VALUE_MATE + MAX_PLY + 1
+                                                      :  VALUE_DRAW;
   }
 
   return begin + num_moves;
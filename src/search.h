@@ -22,6 +22,8 @@
 #define SEARCH_H
 
 #include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "misc.h"
 #include "position.h"
@@ -35,12 +37,17 @@ typedef CounterMoveStats CounterMoveHistoryStats[16][64];
 // move we store a score and a PV (really a refutation in the case of moves
 // which fail low). Score is normally set at -VALUE_INFINITE for all non-pv
 // moves.
+//
+// The PV itself lives in the pvTable of the RootMoves and stays where it is
+// when the root moves are sorted, so that only the small RootMove structs
+// move. A RootMove copied to other RootMoves takes its PV along through
+// root_move_copy().
 
 struct RootMove {
   size_t pv_size;
   Value score;
   Value previousScore;
-  Move pv[MAX_PLY];
+  Move *pv;
 };
 
 typedef struct RootMove RootMove;
@@ -48,10 +55,34 @@ typedef struct RootMove RootMove;
 struct RootMoves {
   size_t size;
   RootMove move[MAX_MOVES];
+  Move pvTable[MAX_MOVES][MAX_PLY];
 };
 
 typedef struct RootMoves RootMoves;
 
+// root_moves_add() appends a root move with a PV of just the move itself.
+// The RootMoves must be filled from size 0, before any sorting.
+
+INLINE void root_moves_add(RootMoves *rm, Move m)
+{
+  RootMove *r = &rm->move[rm->size];
+  r->pv = rm->pvTable[rm->size++];
+  r->pv[0] = m;
+  r->pv_size = 1;
+  r->score = r->previousScore = -VALUE_INFINITE;
+}
+
+// root_move_copy() copies a root move into dst, which keeps its own PV
+// storage.
+
+INLINE void root_move_copy(RootMove *dst, const RootMove *src)
+{
+  dst->pv_size = src->pv_size;
+  dst->score = src->score;
+  dst->previousScore = src->previousScore;
+  memcpy(dst->pv, src->pv, src->pv_size * sizeof(Move));
+}
+
 /// LimitsType struct stores information sent by GUI about available time to
 /// search the current move, maximum depth/time, if we are in analysis mode or
 /// if we have to ponder while it's our opponent's turn to move.
@@ -93,13 +124,110 @@ struct SignalsType {
 
 typedef struct SignalsType SignalsType;
 
-extern SignalsType Signals;
-extern LimitsType Limits;
-extern int TB_RootInTB;
+// Helper threads follow one of these schedules, selected with the "Helper
+// Schedule" option. With Matrix they skip iterations by the rows of the
+// half-density matrix, with Offset they search a fixed number of plies
+// ahead of the main thread and with Partition they search all depths but
+// each starts every iteration with a root move of its own.
+
+#define SCHEDULE_MATRIX    0
+#define SCHEDULE_OFFSET    1
+#define SCHEDULE_PARTITION 2
+
+// With "SMP Mode" set to YBWC, the helpers do not search by themselves.
+// A thread that has searched the first move of a node of at least "Min
+// Split Depth" plies opens a SplitPoint for the remaining moves, and the
+// idle helpers it recruits search them together with it.
+
+#define SMP_LAZY 0
+#define SMP_YBWC 1
+
+#define MAX_SPLITPOINTS_PER_THREAD 8
+
+struct SplitPoint {
+  LOCK_T lock;
+  SplitPoint *parent;
+  Depth depth;
+  Value beta;
+  int pvNode, cutNode;
+  Move moves[MAX_MOVES];    // Taken from the move picker of the node
+  int numMoves;
+  atomic_int nextMove;
+  atomic_int cutoff;
+  atomic_int workers;       // Recruited threads still searching
+
+  // Guarded by lock
+  Value alpha, bestValue;
+  Move bestMove;
+  int moveCount;
+};
+
+struct YBWC {
+  Depth splitDepth;         // DEPTH_MAX unless YBWC is enabled
+  atomic_int idle;          // Helpers waiting to be recruited
+};
+
+// cutoff_occurred() tells whether a split point the thread is working
+// under has failed high, so that its search can be abandoned.
+
+INLINE int cutoff_occurred(const Pos *pos)
+{
+  for (SplitPoint *sp = pos->activeSplitPoint; sp; sp = sp->parent)
+    if (atomic_load_explicit(&sp->cutoff, memory_order_relaxed))
+      return 1;
+  return 0;
+}
+
+// StopLatency records by how many milliseconds searches limited by
+// movetime overran their limit, measured when all threads have stopped.
+
+struct StopLatency {
+  TimePoint total, max;
+  int count;
+};
+
+// SearchLatency records in microseconds how long it took from "go" until
+// all threads had entered the search, and from the moment signals.stop was
+// raised until the best move was reported.
+
+struct SearchLatency {
+  uint64_t goTime;          // Start of the current search
+  atomic_ullong stopTime;   // First raise of signals.stop, or 0
+  atomic_int numStarted;    // Threads that have entered thread_search()
+  uint64_t startedTime;     // When the last of them did
+  uint64_t goTotal, goMax, stopTotal, stopMax;
+  int goCount, stopCount;
+};
+
+// With "MultiPV Split" each thread searches only its own share of the root
+// moves, for the best MultiPV lines among them. SplitPV collects the lines
+// of the last iteration each thread completed, one entry per root move.
+// The main thread merges them into the best MultiPV lines overall.
+
+struct SplitPV {
+  int active;
+  LOCK_T lock;
+  int version, reported;    // Publications so far, and as of the last report
+  RootMoves moves;
+  Depth depth[MAX_MOVES];
+  RootMoves merged;         // Main thread only
+  Depth mergedDepth[MAX_MOVES];
+};
+
+// Easy move code for detecting an 'easy move'. If the PV is stable across
+// multiple search iterations, we can quickly return the best move.
+
+struct EasyMove {
+  int stableCnt;
+  Key expectedPosKey;
+  Move pv[3];
+};
 
 void search_init();
-void search_clear();
+void search_clear(Engine *engine);
 uint64_t perft(Pos *pos, Depth depth);
+void check_time(Engine *engine);
+void search_print_latency(Engine *engine, FILE *F);
 
 #endif
 
@@ -1,24 +1,152 @@
+#ifndef __WIN32__
+#include <pthread.h>
+#else
+#include <windows.h>
+#endif
+#include <string.h>
+
+#include "engine.h"
 #include "numa.h"
 #include "settings.h"
 #include "thread.h"
 #include "tt.h"
 #include "types.h"
+#include "uci.h"
 
 struct settings settings, delayed_settings;
 
-// Process Hash, Threads, NUMA and LargePages settings.
+static void apply_delayed_settings(void);
+
+// Changes of Hash, Threads, NUMA, thread binding, LargePages and Shared
+// Hash are applied eagerly by a background job started from the UI thread
+// after each "setoption", so that "go" does not have to allocate the table
+// or create threads inside the time budget of the move. Only one job runs
+// at a time; anything that needs the settings to be in place waits for it
+// first.
+
+#ifndef __WIN32__
+static pthread_t job;
+#else
+static HANDLE job;
+#endif
+static int job_running;
+
+#ifndef __WIN32__
+static void *job_func(void *arg)
+{
+  (void)arg;
+  apply_delayed_settings();
+  return NULL;
+}
+#else
+static DWORD WINAPI job_func(LPVOID arg)
+{
+  (void)arg;
+  apply_delayed_settings();
+  return 0;
+}
+#endif
+
+// wait_for_delayed_settings() waits until a running background job has
+// finished.
+
+void wait_for_delayed_settings(void)
+{
+  if (!job_running)
+    return;
+
+#ifndef __WIN32__
+  pthread_join(job, NULL);
+#else
+  WaitForSingleObject(job, INFINITE);
+  CloseHandle(job);
+#endif
+  job_running = 0;
+}
+
+// search_running() returns true while the threads of UciEngine may still
+// use the table and the thread pool. A search that has finished on its own
+// is collected here, so that its threads are idle before they are changed.
+
+static int search_running(void)
+{
+  if (!UciEngine->signals.searching)
+    return 0;
+  if (threads_main(UciEngine)->searching)
+    return 1;
+  engine_wait(UciEngine);
+  return 0;
+}
+
+// process_delayed_settings_async() starts a background job if a change is
+// pending. It falls back to applying the change synchronously if no thread
+// can be created. During a search the change stays pending until the next
+// "isready" or "go".
+
+void process_delayed_settings_async(void)
+{
+  wait_for_delayed_settings();
+
+  if (!delayed_settings_pending() || search_running())
+    return;
+
+#ifndef __WIN32__
+  job_running = !pthread_create(&job, NULL, job_func, NULL);
+#else
+  job_running = !!(job = CreateThread(NULL, 0, job_func, NULL, 0, NULL));
+#endif
+
+  if (!job_running)
+    apply_delayed_settings();
+}
+
+// process_delayed_settings() makes sure that all changes are in place,
+// unless a search is still running.
 
 void process_delayed_settings(void)
+{
+  wait_for_delayed_settings();
+  if (!search_running())
+    apply_delayed_settings();
+}
+
+int delayed_settings_pending(void)
+{
+  return   delayed_settings.tt_size != settings.tt_size
+        || delayed_settings.large_pages != settings.large_pages
+        || delayed_settings.num_threads != settings.num_threads
+        || delayed_settings.bind_threads != settings.bind_threads
+        || delayed_settings.history_per_l3 != settings.history_per_l3
+        || strcmp(delayed_settings.shm_name, settings.shm_name) != 0
+        || settings.numa_enabled != delayed_settings.numa_enabled
+        || (   settings.numa_enabled
+            && !masks_equal(settings.mask, delayed_settings.mask));
+}
+
+// Process Hash, Threads, NUMA, thread binding and LargePages settings.
+
+static void apply_delayed_settings(void)
 {
   int tt_change = delayed_settings.tt_size != settings.tt_size;
   int lp_change = delayed_settings.large_pages != settings.large_pages;
+  int shm_change = strcmp(delayed_settings.shm_name, settings.shm_name) != 0;
   int numa_change =   (settings.numa_enabled != delayed_settings.numa_enabled)
                    || (   settings.numa_enabled
                        && !masks_equal(settings.mask, delayed_settings.mask));
+  int placement_change =   delayed_settings.bind_threads != settings.bind_threads
+                        || delayed_settings.history_per_l3 != settings.history_per_l3;
+
+  // Threads pick their cpu and counter move history table when they start.
+  if (placement_change) {
+    threads_set_number(UciEngine, 0);
+    settings.num_threads = 0;
+    settings.bind_threads = delayed_settings.bind_threads;
+    settings.history_per_l3 = delayed_settings.history_per_l3;
+  }
 
 #ifdef NUMA
   if (numa_change) {
-    threads_set_number(0);
+    threads_set_number(UciEngine, 0);
     settings.num_threads = 0;
 #ifndef __WIN32__
     if ((settings.numa_enabled = delayed_settings.numa_enabled))
@@ -30,14 +158,14 @@ void process_delayed_settings(void)
 
   if (settings.num_threads != delayed_settings.num_threads) {
     settings.num_threads = delayed_settings.num_threads;
-    threads_set_number(settings.num_threads);
+    threads_set_number(UciEngine, settings.num_threads);
   }
 
-  if (numa_change || tt_change || lp_change) {
-    tt_free();
+  if (numa_change || tt_change || lp_change || shm_change) {
     settings.large_pages = delayed_settings.large_pages;
     settings.tt_size = delayed_settings.tt_size;
-    tt_allocate(settings.tt_size);
+    strcpy(settings.shm_name, delayed_settings.shm_name);
+    tt_resize(UciEngine, settings.tt_size);
   }
 }
 
@@ -9,11 +9,17 @@ struct settings {
   size_t tt_size;
   size_t num_threads;
   int large_pages;
+  char shm_name[256]; // Name of the shared hash segment or empty
+  int bind_threads;
+  int history_per_l3;
 };
 
 extern struct settings settings, delayed_settings;
 
 void process_delayed_settings(void);
+void process_delayed_settings_async(void);
+void wait_for_delayed_settings(void);
+int delayed_settings_pending(void);
 
 #endif
 
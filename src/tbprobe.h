@@ -11,6 +11,7 @@ int TB_probe_wdl(Pos *pos, int *success);
 int TB_probe_dtz(Pos *pos, int *success);
 int TB_root_probe(Pos *pos, ExtMove *rm, size_t *num_moves, Value *score);
 int TB_root_probe_wdl(Pos *pos, ExtMove *rm, size_t *num_moves, Value *score);
-ExtMove *TB_filter_root_moves(Pos *pos, ExtMove *begin, ExtMove *last);
+ExtMove *TB_filter_root_moves(Engine *engine, Pos *pos, ExtMove *begin,
+                              ExtMove *last);
 
 #endif
@@ -18,132 +18,294 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define _GNU_SOURCE
+
 #include <assert.h>
+#ifndef __WIN32__
+#include <sys/mman.h>
+#include <time.h>
+#endif
 
 #include "material.h"
 #include "movegen.h"
 #include "movepick.h"
+#include "engine.h"
 #include "numa.h"
 #include "pawns.h"
 #include "search.h"
 #include "settings.h"
 #include "thread.h"
+#include "topology.h"
 #include "uci.h"
 #include "tbprobe.h"
 
-// Global objects
-ThreadPool Threads;
-MainThread mainThread;
-CounterMoveHistoryStats **cmh_tables = NULL;
-int num_cmh_tables = 0;
+#ifdef USE_FUTEX
 
-// thread_init() is where a search thread starts and initialises itself.
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
-void thread_init(void *arg)
+// With USE_FUTEX, a parked thread first spins for up to "Spin Wait"
+// microseconds and then sleeps on a futex. Starting a search bumps the
+// wake sequence of the pool and releases all helpers with one system call
+// instead of signalling a condition variable per thread.
+
+static void futex_wait(atomic_int *addr, int val)
+{
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_int *addr)
+{
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+INLINE void cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_ia32_pause();
+#endif
+}
+
+// spin_wait() spins until *addr no longer equals val, but for no longer
+// than the "Spin Wait" option allows. It returns whether the value changed.
+
+static int spin_wait(atomic_int *addr, int val)
+{
+  int budget = option_value(OPT_SPIN_WAIT);
+  if (!budget)
+    return 0;
+
+  uint64_t end = now_us() + budget;
+  for (unsigned i = 1; ; i++) {
+    if (atomic_load_explicit(addr, memory_order_relaxed) != val)
+      return 1;
+    cpu_relax();
+    if (!(i & 255) && now_us() >= end)
+      return 0;
+  }
+}
+
+// wake_all() releases every thread parked on the wake sequence.
+
+static void wake_all(ThreadPool *threads)
+{
+  atomic_fetch_add(&threads->wakeSeq, 1);
+  futex_wake(&threads->wakeSeq);
+}
+
+#endif
+
+// ThreadArg passes the engine and index of a new thread to thread_init().
+
+typedef struct {
+  Engine *engine;
+  int idx;
+#ifndef __WIN32__
+  pthread_t thread;
+#else
+  HANDLE thread;
+#endif
+} ThreadArg;
+
+// A ThreadArena holds the position and all tables of one search thread.
+// The thread maps it itself and touches every page once, so that with
+// NUMA all of it ends up on the node the thread was bound to. It is backed
+// by transparent huge pages if LargePages is set.
+
+typedef struct {
+  Pos pos;
+  PawnEntry pawnTable[16384];
+  MaterialEntry materialTable[8192];
+  HistoryStats history;
+  MoveStats counterMoves;
+  FromToStats fromTo;
+  RootMoves rootMoves;
+  SplitPoint splitPoints[MAX_SPLITPOINTS_PER_THREAD];
+  Stack stack[5 + MAX_PLY + 10];
+  Move pvTable[MAX_PLY + 2][MAX_PLY + 1];
+  ExtMove moveList[10000];
+  void *mem;
+  size_t alloc_size;
+} ThreadArena;
+
+static ThreadArena *arena_alloc(void)
 {
-  int idx = (intptr_t)arg;
+  void *mem;
+  size_t alloc_size;
+
+#ifndef __WIN32__
+
+  size_t alignment = settings.large_pages ? (1ULL << 21) : 1;
+  alloc_size = sizeof(ThreadArena) + alignment - 1;
+  mem = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    fprintf(stderr, "Failed to allocate memory for a search thread.\n");
+    exit(EXIT_FAILURE);
+  }
+  ThreadArena *arena = (ThreadArena *)(  ((uintptr_t)mem + alignment - 1)
+                                       & ~(alignment - 1));
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (settings.large_pages)
+    madvise(arena, sizeof(ThreadArena), MADV_HUGEPAGE);
+#endif
+
+  for (size_t i = 0; i < sizeof(ThreadArena); i += 4096)
+    ((volatile char *)arena)[i] = 0;
 
-  int node;
+#else
+
+  alloc_size = sizeof(ThreadArena);
   if (settings.numa_enabled)
-    node = bind_thread_to_numa_node(idx);
+    mem = numa_alloc(alloc_size);
+  else
+    mem = calloc(alloc_size, 1);
+  ThreadArena *arena = mem;
+
+#endif
+
+  arena->mem = mem;
+  arena->alloc_size = alloc_size;
+  return arena;
+}
+
+static void arena_free(ThreadArena *arena)
+{
+#ifndef __WIN32__
+  munmap(arena->mem, arena->alloc_size);
+#else
+  if (settings.numa_enabled)
+    numa_free(arena->mem, arena->alloc_size);
   else
-    node = 0;
-  if (node >= num_cmh_tables) {
-    int old = num_cmh_tables;
-    num_cmh_tables = node + 16;
-    cmh_tables = realloc(cmh_tables,
-                         num_cmh_tables * sizeof(CounterMoveHistoryStats *));
-    while (old < num_cmh_tables)
-      cmh_tables[old++] = NULL;
+    free(arena->mem);
+#endif
+}
+
+// thread_init() is where a search thread starts and initialises itself.
+
+void thread_init(void *arg)
+{
+  Engine *engine = ((ThreadArg *)arg)->engine;
+  ThreadPool *threads = &engine->threads;
+  int idx = ((ThreadArg *)arg)->idx;
+
+  // A thread bound to a cpu shares its counter move history table with
+  // the threads of its L3 domain if History per L3 is set, otherwise with
+  // those of its NUMA node.
+  int node = 0, l3;
+  if (settings.bind_threads && topology_bind_thread(idx, &node, &l3)) {
+    if (settings.history_per_l3)
+      node = l3;
+    else if (!settings.numa_enabled)
+      node = 0;
   }
-  if (!cmh_tables[node]) {
+  else if (settings.numa_enabled)
+    node = bind_thread_to_numa_node(idx);
+
+  // Threads start in parallel, so only one at a time may look for the
+  // counter move history table of its node.
+  LOCK(threads->lock);
+  if (node >= threads->num_cmh_tables) {
+    int old = threads->num_cmh_tables;
+    threads->num_cmh_tables = node + 16;
+    threads->cmh_tables = realloc(threads->cmh_tables,
+              threads->num_cmh_tables * sizeof(CounterMoveHistoryStats *));
+    while (old < threads->num_cmh_tables)
+      threads->cmh_tables[old++] = NULL;
+  }
+  if (!threads->cmh_tables[node]) {
     if (settings.numa_enabled)
-      cmh_tables[node] = numa_alloc(sizeof(CounterMoveHistoryStats));
+      threads->cmh_tables[node] = numa_alloc(sizeof(CounterMoveHistoryStats));
     else
-      cmh_tables[node] = calloc(sizeof(CounterMoveHistoryStats), 1);
-  }
-
-  Pos *pos;
-
-  if (settings.numa_enabled) {
-    pos = numa_alloc(sizeof(Pos));
-    pos->pawnTable = numa_alloc(16384 * sizeof(PawnEntry));
-    pos->materialTable = numa_alloc(8192 * sizeof(MaterialEntry));
-    pos->history = numa_alloc(sizeof(HistoryStats));
-    pos->counterMoves = numa_alloc(sizeof(MoveStats));
-    pos->fromTo = numa_alloc(sizeof(FromToStats));
-    pos->rootMoves = numa_alloc(sizeof(RootMoves));
-    pos->stack = numa_alloc((5 + MAX_PLY + 10) * sizeof(Stack));
-    pos->moveList = numa_alloc(10000 * sizeof(ExtMove));
-  } else {
-    pos = calloc(sizeof(Pos), 1);
-    pos->pawnTable = calloc(16384 * sizeof(PawnEntry), 1);
-    pos->materialTable = calloc(8192 * sizeof(MaterialEntry), 1);
-    pos->history = calloc(sizeof(HistoryStats), 1);
-    pos->counterMoves = calloc(sizeof(MoveStats), 1);
-    pos->fromTo = calloc(sizeof(FromToStats), 1);
-    pos->rootMoves = calloc(sizeof(RootMoves), 1);
-    pos->stack = calloc((5 + MAX_PLY + 10) * sizeof(Stack), 1);
-    pos->moveList = calloc(10000 * sizeof(ExtMove), 1);
+      threads->cmh_tables[node] = calloc(sizeof(CounterMoveHistoryStats), 1);
   }
+  CounterMoveHistoryStats *cmh = threads->cmh_tables[node];
+  UNLOCK(threads->lock);
+
+  ThreadArena *arena = arena_alloc();
+  Pos *pos = &arena->pos;
+  pos->pawnTable = arena->pawnTable;
+  pos->materialTable = arena->materialTable;
+  pos->history = &arena->history;
+  pos->counterMoves = &arena->counterMoves;
+  pos->fromTo = &arena->fromTo;
+  pos->rootMoves = &arena->rootMoves;
+  pos->splitPoints = arena->splitPoints;
+  for (int i = 0; i < MAX_SPLITPOINTS_PER_THREAD; i++)
+    LOCK_INIT(pos->splitPoints[i].lock);
+  pos->stack = arena->stack;
+  pos->pvTable = arena->pvTable;
+  pos->moveList = arena->moveList;
+  pos->engine = engine;
   pos->thread_idx = idx;
   pos->stack += 5;
-  pos->counterMoveHistory = cmh_tables[node];
+  pos->counterMoveHistory = cmh;
 
-  atomic_store(&pos->resetCalls, 0);
   pos->exit = 0;
-  pos->maxPly = pos->callsCnt = 0;
+  pos->maxPly = 0;
+
+  threads->pos[idx] = pos;
 
 #ifndef __WIN32__  // linux
 
   pthread_mutex_init(&pos->mutex, NULL);
   pthread_cond_init(&pos->sleepCondition, NULL);
 
-  Threads.pos[idx] = pos;
-
-  pthread_mutex_lock(&Threads.mutex);
-  Threads.initializing = 0;
-  pthread_cond_signal(&Threads.sleepCondition);
-  pthread_mutex_unlock(&Threads.mutex);
+  pthread_mutex_lock(&threads->mutex);
+  if (--threads->initializing == 0)
+    pthread_cond_signal(&threads->sleepCondition);
+  pthread_mutex_unlock(&threads->mutex);
 
 #else // Windows
 
   pos->startEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
   pos->stopEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
 
-  Threads.pos[idx] = pos;
-
-  SetEvent(Threads.event);
+  if (atomic_fetch_sub(&threads->initializing, 1) == 1)
+    SetEvent(threads->event);
 
 #endif
 
   thread_idle_loop(pos);
 }
 
-// thread_create() launches a new thread.
+// threads_create() launches the threads with indices first to last - 1
+// all at once and waits until each of them has initialised itself.
 
-void thread_create(int idx)
+static void threads_create(Engine *engine, size_t first, size_t last)
 {
-#ifndef __WIN32__
+  ThreadPool *threads = &engine->threads;
+  ThreadArg *args = malloc((last - first) * sizeof(ThreadArg));
 
-  pthread_t thread;
-
-  Threads.initializing = 1;
-  pthread_mutex_lock(&Threads.mutex);
-  pthread_create(&thread, NULL, (void*(*)(void*))thread_init,
-                 (void *)(intptr_t)idx);
-  while (Threads.initializing)
-    pthread_cond_wait(&Threads.sleepCondition, &Threads.mutex);
-  pthread_mutex_unlock(&Threads.mutex);
+  threads->initializing = last - first;
 
+  for (size_t idx = first; idx < last; idx++) {
+    ThreadArg *arg = &args[idx - first];
+    arg->engine = engine;
+    arg->idx = idx;
+#ifndef __WIN32__
+    pthread_create(&arg->thread, NULL, (void*(*)(void*))thread_init, arg);
 #else
+    arg->thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)thread_init, arg, 0 , NULL);
+#endif
+  }
 
-  HANDLE *thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)thread_init, (void *)(intptr_t)idx, 0 , NULL);
-  WaitForSingleObject(Threads.event, INFINITE);
-
+#ifndef __WIN32__
+  pthread_mutex_lock(&threads->mutex);
+  while (threads->initializing)
+    pthread_cond_wait(&threads->sleepCondition, &threads->mutex);
+  pthread_mutex_unlock(&threads->mutex);
+#else
+  WaitForSingleObject(threads->event, INFINITE);
 #endif
 
-  Threads.pos[idx]->nativeThread = thread;
+  for (size_t idx = first; idx < last; idx++)
+    threads->pos[idx]->nativeThread = args[idx - first].thread;
+
+  free(args);
 }
 
 
@@ -151,7 +313,13 @@ void thread_create(int idx)
 
 void thread_destroy(Pos *pos)
 {
-#ifndef __WIN32__
+#if defined(USE_FUTEX)
+  pos->exit = 1;
+  wake_all(&pos->engine->threads);
+  pthread_join(pos->nativeThread, NULL);
+  pthread_cond_destroy(&pos->sleepCondition);
+  pthread_mutex_destroy(&pos->mutex);
+#elif !defined(__WIN32__)
   pthread_mutex_lock(&pos->mutex);
   pos->exit = 1;
   pthread_cond_signal(&pos->sleepCondition);
@@ -167,27 +335,9 @@ void thread_destroy(Pos *pos)
   CloseHandle(pos->stopEvent);
 #endif
 
-  if (settings.numa_enabled) {
-    numa_free(pos->pawnTable, 16384 * sizeof(PawnEntry));
-    numa_free(pos->materialTable, 8192 * sizeof(MaterialEntry));
-    numa_free(pos->history, sizeof(HistoryStats));
-    numa_free(pos->counterMoves, sizeof(MoveStats));
-    numa_free(pos->fromTo, sizeof(FromToStats));
-    numa_free(pos->rootMoves, sizeof(RootMoves));
-    numa_free(pos->stack - 5, (5 + MAX_PLY + 10) * sizeof(Stack));
-    numa_free(pos->moveList, 10000 * sizeof(ExtMove));
-    numa_free(pos, sizeof(Pos));
-  } else {
-    free(pos->pawnTable);
-    free(pos->materialTable);
-    free(pos->history);
-    free(pos->counterMoves);
-    free(pos->fromTo);
-    free(pos->rootMoves);
-    free(pos->stack - 5);
-    free(pos->moveList);
-    free(pos);
-  }
+  for (int i = 0; i < MAX_SPLITPOINTS_PER_THREAD; i++)
+    LOCK_DESTROY(pos->splitPoints[i].lock);
+  arena_free((ThreadArena *)pos);
 }
 
 
@@ -196,7 +346,11 @@ void thread_destroy(Pos *pos)
 
 void thread_wait_for_search_finished(Pos *pos)
 {
-#ifndef __WIN32__
+#if defined(USE_FUTEX)
+  while (pos->searching)
+    if (!spin_wait(&pos->searching, 1))
+      futex_wait(&pos->searching, 1);
+#elif !defined(__WIN32__)
   pthread_mutex_lock(&pos->mutex);
   while (pos->searching)
     pthread_cond_wait(&pos->sleepCondition, &pos->mutex);
@@ -206,7 +360,7 @@ void thread_wait_for_search_finished(Pos *pos)
 #endif
 
   if (pos->thread_idx == 0)
-    Signals.searching = 0;
+    pos->engine->signals.searching = 0;
 }
 
 
@@ -214,7 +368,15 @@ void thread_wait_for_search_finished(Pos *pos)
 
 void thread_wait(Pos *pos, atomic_bool *condition)
 {
-#ifndef __WIN32__
+#if defined(USE_FUTEX)
+  ThreadPool *threads = &pos->engine->threads;
+  while (1) {
+    int seq = atomic_load(&threads->wakeSeq);
+    if (atomic_load(condition))
+      break;
+    futex_wait(&threads->wakeSeq, seq);
+  }
+#elif !defined(__WIN32__)
   pthread_mutex_lock(&pos->mutex);
   while (!atomic_load(condition))
     pthread_cond_wait(&pos->sleepCondition, &pos->mutex);
@@ -230,7 +392,12 @@ void thread_wait(Pos *pos, atomic_bool *condition)
 
 void thread_start_searching(Pos *pos, int resume)
 {
-#ifndef __WIN32__
+#if defined(USE_FUTEX)
+  if (!resume)
+    pos->searching = 1;
+
+  wake_all(&pos->engine->threads);
+#elif !defined(__WIN32__)
   pthread_mutex_lock(&pos->mutex);
 
   if (!resume)
@@ -245,11 +412,58 @@ void thread_start_searching(Pos *pos, int resume)
 }
 
 
+// threads_start_searching() wakes up the threads from index first on. With
+// USE_FUTEX they are all released by a single wake-up.
+
+void threads_start_searching(Engine *engine, size_t first)
+{
+  ThreadPool *threads = &engine->threads;
+
+#ifdef USE_FUTEX
+  for (size_t idx = first; idx < threads->num_threads; idx++)
+    threads->pos[idx]->searching = 1;
+
+  wake_all(threads);
+#else
+  for (size_t idx = first; idx < threads->num_threads; idx++)
+    thread_start_searching(threads->pos[idx], 0);
+#endif
+}
+
+
 // thread_idle_loop() is where the thread is parked when it has no work to do.
 
 void thread_idle_loop(Pos *pos)
 {
-#ifndef __WIN32__
+#if defined(USE_FUTEX)
+
+  ThreadPool *threads = &pos->engine->threads;
+
+  while (1) {
+
+    while (1) {
+      int seq = atomic_load(&threads->wakeSeq);
+      if (pos->searching || pos->exit)
+        break;
+      if (!spin_wait(&threads->wakeSeq, seq))
+        futex_wait(&threads->wakeSeq, seq);
+    }
+
+    if (pos->exit)
+      break;
+
+    if (threads->task)
+      threads->task(pos);
+    else if (pos->thread_idx == 0)
+      mainthread_search(pos->engine);
+    else
+      thread_search(pos);
+
+    pos->searching = 0;
+    futex_wake(&pos->searching);
+  }
+
+#elif !defined(__WIN32__)
 
   pthread_mutex_lock(&pos->mutex);
   while (1) {
@@ -264,8 +478,10 @@ void thread_idle_loop(Pos *pos)
     if (pos->exit)
       break;
 
-    if (pos->thread_idx == 0)
-      mainthread_search();
+    if (pos->engine->threads.task)
+      pos->engine->threads.task(pos);
+    else if (pos->thread_idx == 0)
+      mainthread_search(pos->engine);
     else
       thread_search(pos);
 
@@ -281,8 +497,10 @@ void thread_idle_loop(Pos *pos)
     if (pos->exit)
       break;
 
-    if (pos->thread_idx == 0)
-      mainthread_search();
+    if (pos->engine->threads.task)
+      pos->engine->threads.task(pos);
+    else if (pos->thread_idx == 0)
+      mainthread_search(pos->engine);
     else
       thread_search(pos);
 
@@ -293,48 +511,186 @@ void thread_idle_loop(Pos *pos)
 }
 
 
-// threads_init() creates and launches requested threads that will go
-// immediately to sleep. We cannot use a constructor because Threads is a
-// static object and we need a fully initialized engine at this point due to
-// allocation of Endgames in the Thread constructor.
+// The timer thread checks the time and node limits of the running search
+// every millisecond, so that the search threads only have to read
+// signals.stop. It holds the timer lock while checking, so that
+// timer_stop() returns only once check_time() is no longer looking at the
+// search.
 
-void threads_init(void)
+#ifndef __WIN32__
+
+static void *timer_loop(void *arg)
+{
+  Engine *engine = arg;
+  struct Timer *timer = &engine->threads.timer;
+
+  LOCK(timer->lock);
+  while (!timer->exit) {
+    if (!timer->active) {
+      pthread_cond_wait(&timer->cond, &timer->lock);
+      continue;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    if ((ts.tv_nsec += 1000000) >= 1000000000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&timer->cond, &timer->lock, &ts);
+    if (timer->active && !timer->exit)
+      check_time(engine);
+  }
+  UNLOCK(timer->lock);
+
+  return NULL;
+}
+
+#else
+
+static DWORD WINAPI timer_loop(LPVOID arg)
+{
+  Engine *engine = arg;
+  struct Timer *timer = &engine->threads.timer;
+
+  while (1) {
+    WaitForSingleObject(timer->event, timer->active ? 1 : INFINITE);
+    if (timer->exit)
+      break;
+    LOCK(timer->lock);
+    if (timer->active)
+      check_time(engine);
+    UNLOCK(timer->lock);
+  }
+
+  return 0;
+}
+
+#endif
+
+// timer_start() makes the timer thread watch the search that is starting.
+
+void timer_start(Engine *engine)
 {
+  struct Timer *timer = &engine->threads.timer;
+
+  LOCK(timer->lock);
+  timer->active = 1;
 #ifndef __WIN32__
-  pthread_mutex_init(&Threads.mutex, NULL);
-  pthread_cond_init(&Threads.sleepCondition, NULL);
+  pthread_cond_signal(&timer->cond);
 #else
+  SetEvent(timer->event);
+#endif
+  UNLOCK(timer->lock);
+}
+
+// timer_stop() makes the timer thread go back to sleep.
+
+void timer_stop(Engine *engine)
+{
+  struct Timer *timer = &engine->threads.timer;
+
+  LOCK(timer->lock);
+  timer->active = 0;
+  UNLOCK(timer->lock);
+}
+
+
+// threads_init() sets up what all engines of the process share. The
+// threads themselves belong to an engine and are created by
+// threads_pool_init().
+
+void threads_init(void)
+{
+#ifdef __WIN32__
   io_mutex = CreateMutex(NULL, FALSE, NULL);
-  Threads.event = CreateEvent(NULL, FALSE, FALSE, NULL);
 #endif
 
 #ifdef NUMA
   numa_init();
 #endif
-
-  Threads.num_threads = 1;
-  thread_create(0);
+  topology_init();
 }
 
 
-// threads_exit() terminates threads before the program exits. Cannot be
-// done in destructor because threads must be terminated before deleting
-// any static objects while still in main().
+// threads_exit() releases what threads_init() set up. All engines must have
+// been destroyed.
 
 void threads_exit(void)
 {
-  threads_set_number(0);
-
-#ifndef __WIN32__
-  pthread_cond_destroy(&Threads.sleepCondition);
-  pthread_mutex_destroy(&Threads.mutex);
-#else
+#ifdef __WIN32__
   CloseHandle(io_mutex);
-  CloseHandle(Threads.event);
 #endif
 
 #ifdef NUMA
   numa_exit();
+#endif
+  topology_exit();
+}
+
+
+// threads_pool_init() creates the timer thread and the main search thread
+// of an engine, which go immediately to sleep.
+
+void threads_pool_init(Engine *engine)
+{
+  ThreadPool *threads = &engine->threads;
+  struct Timer *timer = &threads->timer;
+
+#ifndef __WIN32__
+  pthread_mutex_init(&threads->mutex, NULL);
+  pthread_cond_init(&threads->sleepCondition, NULL);
+#else
+  threads->event = CreateEvent(NULL, FALSE, FALSE, NULL);
+#endif
+
+  LOCK_INIT(threads->lock);
+  LOCK_INIT(timer->lock);
+#ifndef __WIN32__
+  pthread_cond_init(&timer->cond, NULL);
+  pthread_create(&timer->nativeThread, NULL, timer_loop, engine);
+#else
+  timer->event = CreateEvent(NULL, FALSE, FALSE, NULL);
+  timer->nativeThread = CreateThread(NULL, 0, timer_loop, engine, 0, NULL);
+#endif
+
+  threads_set_number(engine, 1);
+}
+
+
+// threads_pool_exit() terminates the threads of an engine.
+
+void threads_pool_exit(Engine *engine)
+{
+  ThreadPool *threads = &engine->threads;
+  struct Timer *timer = &threads->timer;
+
+  threads_set_number(engine, 0);
+  free(threads->pos);
+  threads->pos = NULL;
+  threads->pos_size = 0;
+
+  LOCK(timer->lock);
+  timer->exit = 1;
+#ifndef __WIN32__
+  pthread_cond_signal(&timer->cond);
+  UNLOCK(timer->lock);
+  pthread_join(timer->nativeThread, NULL);
+  pthread_cond_destroy(&timer->cond);
+#else
+  SetEvent(timer->event);
+  UNLOCK(timer->lock);
+  WaitForSingleObject(timer->nativeThread, INFINITE);
+  CloseHandle(timer->nativeThread);
+  CloseHandle(timer->event);
+#endif
+  LOCK_DESTROY(timer->lock);
+  LOCK_DESTROY(threads->lock);
+
+#ifndef __WIN32__
+  pthread_cond_destroy(&threads->sleepCondition);
+  pthread_mutex_destroy(&threads->mutex);
+#else
+  CloseHandle(threads->event);
 #endif
 }
 
@@ -342,50 +698,80 @@ void threads_exit(void)
 // threads_set_number() creates/destroys threads to match the requested
 // number.
 
-void threads_set_number(size_t num)
+void threads_set_number(Engine *engine, size_t num)
 {
-  while (Threads.num_threads < num)
-    thread_create(Threads.num_threads++);
+  ThreadPool *threads = &engine->threads;
 
-  while (Threads.num_threads > num)
-    thread_destroy(Threads.pos[--Threads.num_threads]);
+  if (num > threads->pos_size) {
+    threads->pos_size = max(num, 2 * threads->pos_size);
+    threads->pos = realloc(threads->pos, threads->pos_size * sizeof(Pos *));
+  }
 
-  if (num == 0 && num_cmh_tables > 0) {
-    for (int i = 0; i < num_cmh_tables; i++)
-      if (cmh_tables[i]) {
+  if (threads->num_threads < num) {
+    threads_create(engine, threads->num_threads, num);
+    threads->num_threads = num;
+  }
+
+  while (threads->num_threads > num)
+    thread_destroy(threads->pos[--threads->num_threads]);
+
+  if (num == 0 && threads->num_cmh_tables > 0) {
+    for (int i = 0; i < threads->num_cmh_tables; i++)
+      if (threads->cmh_tables[i]) {
         if (settings.numa_enabled)
-          numa_free(cmh_tables[i], sizeof(CounterMoveHistoryStats));
+          numa_free(threads->cmh_tables[i], sizeof(CounterMoveHistoryStats));
         else
-          free(cmh_tables[i]);
+          free(threads->cmh_tables[i]);
       }
-    free(cmh_tables);
-    cmh_tables = NULL;
-    num_cmh_tables = 0;
+    free(threads->cmh_tables);
+    threads->cmh_tables = NULL;
+    threads->num_cmh_tables = 0;
   }
 
   if (num == 0)
-    Signals.searching = 0;
+    engine->signals.searching = 0;
+}
+
+
+// threads_run() lets all threads of the pool execute the given task in
+// parallel and waits for them to finish. The task can find out which part
+// of the work is its own from pos->thread_idx and threads.num_threads.
+
+void threads_run(Engine *engine, void (*task)(Pos *pos))
+{
+  ThreadPool *threads = &engine->threads;
+
+  threads->task = task;
+
+  threads_start_searching(engine, 0);
+
+  for (size_t idx = 0; idx < threads->num_threads; idx++)
+    thread_wait_for_search_finished(threads->pos[idx]);
+
+  threads->task = NULL;
 }
 
 
 // threads_nodes_searched() returns the number of nodes searched.
 
-uint64_t threads_nodes_searched(void)
+uint64_t threads_nodes_searched(Engine *engine)
 {
+  ThreadPool *threads = &engine->threads;
   uint64_t nodes = 0;
-  for (size_t idx = 0; idx < Threads.num_threads; idx++)
-    nodes += Threads.pos[idx]->nodes;
+  for (size_t idx = 0; idx < threads->num_threads; idx++)
+    nodes += threads->pos[idx]->nodes;
   return nodes;
 }
 
 
 // threads_tb_hits() returns the number of TB hits.
 
-uint64_t threads_tb_hits(void)
+uint64_t threads_tb_hits(Engine *engine)
 {
+  ThreadPool *threads = &engine->threads;
   uint64_t hits = 0;
-  for (size_t idx = 0; idx < Threads.num_threads; idx++)
-    hits += Threads.pos[idx]->tb_hits;
+  for (size_t idx = 0; idx < threads->num_threads; idx++)
+    hits += threads->pos[idx]->tb_hits;
   return hits;
 }
 
@@ -393,18 +779,24 @@ uint64_t threads_tb_hits(void)
 // threads_start_thinking() wakes up the main thread sleeping in
 // idle_loop() and starts a new search, then returns immediately.
 
-void threads_start_thinking(Pos *root, LimitsType *limits)
+void threads_start_thinking(Engine *engine, Pos *root, LimitsType *limits)
 {
-  if (Signals.searching)
-    thread_wait_for_search_finished(threads_main());
+  ThreadPool *threads = &engine->threads;
 
-  Signals.stopOnPonderhit = Signals.stop = 0;
-  Limits = *limits;
+  if (engine->signals.searching)
+    thread_wait_for_search_finished(threads_main(engine));
+
+  engine->latency.goTime = now_us();
+  engine->latency.stopTime = 0;
+  engine->latency.numStarted = 0;
+
+  engine->signals.stopOnPonderhit = engine->signals.stop = 0;
+  engine->limits = *limits;
 
   ExtMove list[MAX_MOVES];
   ExtMove *end = generate_legal(root, list);
 
-  end = TB_filter_root_moves(root, list, end);
+  end = TB_filter_root_moves(engine, root, list, end);
 
   ExtMove *p = list;
   for (ExtMove *m = p; m < end; m++) {
@@ -417,25 +809,48 @@ void threads_start_thinking(Pos *root, LimitsType *limits)
   }
   end = p;
 
-  for (size_t idx = 0; idx < Threads.num_threads; idx++) {
-    Pos *pos = Threads.pos[idx];
+  // With split MultiPV, thread idx gets every num_threads-th root move
+  // starting from move idx.
+  struct SplitPV *sp = &engine->split;
+  size_t num = threads->num_threads;
+  sp->active =   option_value(OPT_MULTIPV_SPLIT)
+              && option_value(OPT_MULTI_PV) > 1
+              && num > 1;
+  if (sp->active) {
+    sp->version = sp->reported = 0;
+    sp->moves.size = 0;
+    for (size_t i = 0; i < (size_t)(end - list); i++) {
+      root_moves_add(&sp->moves, list[i].move);
+      sp->depth[i] = DEPTH_ZERO;
+    }
+  }
+
+  // With YBWC the helpers only search at the split points of other threads.
+  engine->ybwc.splitDepth =  option_value(OPT_SMP_MODE) == SMP_YBWC
+                          && num > 1 && !sp->active
+                           ? option_value(OPT_MIN_SPLIT_DEPTH) * ONE_PLY
+                           : DEPTH_MAX;
+  engine->ybwc.idle = 0;
+
+  for (size_t idx = 0; idx < num; idx++) {
+    Pos *pos = threads->pos[idx];
     pos->maxPly = 0;
     pos->rootDepth = DEPTH_ZERO;
     pos->nodes = pos->tb_hits = 0;
     RootMoves *rm = pos->rootMoves;
-    rm->size = end - list;
-    for (size_t i = 0; i < rm->size; i++) {
-      rm->move[i].pv[0] = list[i].move;
-      rm->move[i].score = -VALUE_INFINITE;
-      rm->move[i].previousScore = -VALUE_INFINITE;
+    rm->size = 0;
+    for (size_t i = 0; i < (size_t)(end - list); i++) {
+      if (sp->active && i % num != idx)
+        continue;
+      root_moves_add(rm, list[i].move);
     }
     pos_copy(pos, root);
   }
 
-  if (TB_RootInTB)
-    Threads.pos[0]->tb_hits = end - list;
+  if (engine->tbRootInTB)
+    threads->pos[0]->tb_hits = end - list;
 
-  Signals.searching = 1;
-  thread_start_searching(threads_main(), 0);
+  engine->signals.searching = 1;
+  thread_start_searching(threads_main(engine), 0);
 }
 
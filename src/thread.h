@@ -24,13 +24,15 @@
 #include <stdatomic.h>
 #ifndef __WIN32__
 #include <pthread.h>
+#include <sched.h>
 #else
 #include <windows.h>
 #endif
 
 #include "types.h"
 
-#define MAX_THREADS 128
+// The pool grows as needed, MAX_THREADS only bounds the Threads option.
+#define MAX_THREADS 1024
 
 #ifndef __WIN32__
 #define LOCK_T pthread_mutex_t
@@ -46,8 +48,13 @@
 #define UNLOCK(x) ReleaseMutex(x)
 #endif
 
+#ifndef __WIN32__
+#define thread_yield() sched_yield()
+#else
+#define thread_yield() SwitchToThread()
+#endif
+
 void thread_init(void *arg);
-void thread_create(int idx);
 void thread_search(Pos *pos);
 void thread_idle_loop(Pos *pos);
 void thread_start_searching(Pos *pos, int resume);
@@ -65,9 +72,23 @@ struct MainThread {
 
 typedef struct MainThread MainThread;
 
-extern MainThread mainThread;
+void mainthread_search(Engine *engine);
 
-void mainthread_search();
+
+// The timer thread of a pool checks the time and node limits of the
+// running search, see timer_loop().
+
+struct Timer {
+  LOCK_T lock;
+  int active, exit;
+#ifndef __WIN32__
+  pthread_t nativeThread;
+  pthread_cond_t cond;
+#else
+  HANDLE nativeThread;
+  HANDLE event;
+#endif
+};
 
 
 // ThreadPool struct handles all the threads-related stuff like init,
@@ -75,12 +96,22 @@ void mainthread_search();
 // access to threads data is done through this class.
 
 struct ThreadPool {
-  Pos *pos[MAX_THREADS];
+  Pos **pos;
   size_t num_threads;
+  size_t pos_size; // Allocated length of pos[]
+  void (*task)(Pos *pos); // Run instead of a search by threads_run().
+  int independent; // Threads search their own roots, see analyse().
+  CounterMoveHistoryStats **cmh_tables; // One per NUMA node or L3 domain
+  int num_cmh_tables;
+  struct Timer timer;
+  LOCK_T lock; // Guards cmh_tables while threads start up
+  atomic_int initializing;
+#ifdef USE_FUTEX
+  atomic_int wakeSeq; // Bumped to release parked threads, see thread.c.
+#endif
 #ifndef __WIN32__
   pthread_mutex_t mutex;
   pthread_cond_t sleepCondition;
-  int initializing;
 #else
   HANDLE event;
 #endif
@@ -90,20 +121,18 @@ typedef struct ThreadPool ThreadPool;
 
 void threads_init(void);
 void threads_exit(void);
-void threads_start_thinking(Pos *pos, LimitsType *);
-void threads_set_number(size_t num);
-uint64_t threads_nodes_searched(void);
-uint64_t threads_tb_hits(void);
-
-extern ThreadPool Threads;
-
-INLINE Pos *threads_main(void)
-{
-  return Threads.pos[0];
-}
-
-CounterMoveHistoryStats **cmh_tables;
-int num_cmh_tables;
+void threads_pool_init(Engine *engine);
+void threads_pool_exit(Engine *engine);
+void threads_start_thinking(Engine *engine, Pos *pos, LimitsType *);
+void threads_start_searching(Engine *engine, size_t first);
+void threads_set_number(Engine *engine, size_t num);
+void threads_run(Engine *engine, void (*task)(Pos *pos));
+uint64_t threads_nodes_searched(Engine *engine);
+uint64_t threads_tb_hits(Engine *engine);
+void timer_start(Engine *engine);
+void timer_stop(Engine *engine);
+
+#define threads_main(e) ((e)->threads.pos[0])
 
 #endif
 
@@ -21,12 +21,11 @@
 #include <float.h>
 #include <math.h>
 
+#include "engine.h"
 #include "search.h"
 #include "timeman.h"
 #include "uci.h"
 
-struct TimeManagement Time; // Our global time management struct
-
 #define TIMET_OPTIMUM 0
 #define TIMET_MAXTIME 1
 
@@ -81,8 +80,11 @@ static int remaining(int myTime, int movesToGo, int ply, int slowMover,
 //  inc >  0 && movestogo == 0 means: x basetime + z increment
 //  inc >  0 && movestogo != 0 means: x moves in y minutes + z increment
 
-void time_init(LimitsType *limits, int us, int ply)
+void time_init(Engine *engine, int us, int ply)
 {
+  LimitsType *limits = &engine->limits;
+  struct TimeManagement *tm = &engine->time;
+
   int minThinkingTime = option_value(OPT_MIN_THINK_TIME);
   int moveOverhead    = option_value(OPT_MOVE_OVERHEAD);
   int slowMover       = option_value(OPT_SLOW_MOVER);
@@ -93,17 +95,17 @@ void time_init(LimitsType *limits, int us, int ply)
   // WARNING: Given npms (nodes per millisecond) must be much lower then
   // the real engine speed to avoid time losses.
   if (npmsec) {
-    if (!Time.availableNodes) // Only once at game start
-      Time.availableNodes = npmsec * limits->time[us]; // Time is in msec
+    if (!tm->availableNodes) // Only once at game start
+      tm->availableNodes = npmsec * limits->time[us]; // Time is in msec
 
     // Convert from millisecs to nodes
-    limits->time[us] = (int)Time.availableNodes;
+    limits->time[us] = (int)tm->availableNodes;
     limits->inc[us] *= npmsec;
     limits->npmsec = npmsec;
   }
 
-  Time.startTime = limits->startTime;
-  Time.optimumTime = Time.maximumTime = max(limits->time[us], minThinkingTime);
+  tm->startTime = limits->startTime;
+  tm->optimumTime = tm->maximumTime = max(limits->time[us], minThinkingTime);
 
   int MaxMTG = limits->movestogo ? min(limits->movestogo, MoveHorizon) : MoveHorizon;
 
@@ -121,11 +123,11 @@ void time_init(LimitsType *limits, int us, int ply)
     int t1 = minThinkingTime + remaining(hypMyTime, hypMTG, ply, slowMover, TIMET_OPTIMUM);
     int t2 = minThinkingTime + remaining(hypMyTime, hypMTG, ply, slowMover, TIMET_MAXTIME);
 
-    Time.optimumTime = min(t1, Time.optimumTime);
-    Time.maximumTime = min(t2, Time.maximumTime);
+    tm->optimumTime = min(t1, tm->optimumTime);
+    tm->maximumTime = min(t2, tm->maximumTime);
   }
 
   if (option_value(OPT_PONDER))
-    Time.optimumTime += Time.optimumTime / 4;
+    tm->optimumTime += tm->optimumTime / 4;
 }
 
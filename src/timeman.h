@@ -35,17 +35,12 @@ struct TimeManagement {
   int64_t availableNodes;
 };
 
-extern struct TimeManagement Time;
+void time_init(Engine *engine, int us, int ply);
 
-void time_init(LimitsType *limits, int us, int ply);
-
-#define time_optimum() Time.optimumTime
-#define time_maximum() Time.maximumTime
-
-INLINE int time_elapsed(void)
-{
-  return Limits.npmsec ? threads_nodes_searched() : now() - Time.startTime;
-}
+#define time_optimum(e) (e)->time.optimumTime
+#define time_maximum(e) (e)->time.maximumTime
+#define time_elapsed(e) ( (e)->limits.npmsec ? (int)threads_nodes_searched(e) \
+                         : (int)(now() - (e)->time.startTime))
 
 #endif
 
@@ -0,0 +1,376 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include "settings.h"
+#include "topology.h"
+#include "types.h"
+
+#ifdef __linux__
+
+typedef struct {
+  int cpu;
+  int node;
+  int l3;    // Index of the L3 domain, counted from 0
+  int core;  // Lowest cpu of the physical core
+  int smt;   // 0 for the first sibling of a core, 1 for the second, ...
+} CpuInfo;
+
+static CpuInfo *cpus;
+static int num_cpus, num_cores;
+
+// read_cpu_list() reads a list like "0-3,8,10-11" from the given file
+// into list[] and returns the number of cpus in it.
+
+static int read_cpu_list(const char *name, int *list, int max)
+{
+  FILE *F = fopen(name, "r");
+  if (!F)
+    return 0;
+
+  int n = 0, first, last;
+  char sep;
+  while (fscanf(F, "%d", &first) == 1) {
+    last = first;
+    if (fscanf(F, "%c", &sep) == 1 && sep == '-') {
+      if (fscanf(F, "%d", &last) != 1)
+        break;
+      if (fscanf(F, "%c", &sep) != 1)
+        sep = '\n';
+    }
+    for (int cpu = first; cpu <= last && n < max; cpu++)
+      list[n++] = cpu;
+    if (sep != ',')
+      break;
+  }
+  fclose(F);
+
+  return n;
+}
+
+static int read_int(const char *name, int def)
+{
+  FILE *F = fopen(name, "r");
+  int val;
+  if (!F)
+    return def;
+  if (fscanf(F, "%d", &val) != 1)
+    val = def;
+  fclose(F);
+  return val;
+}
+
+// cpu_node() finds the NUMA node of a cpu from the nodeN link in its
+// sysfs directory.
+
+static int cpu_node(int cpu)
+{
+  char name[64];
+  sprintf(name, "/sys/devices/system/cpu/cpu%d", cpu);
+  DIR *dir = opendir(name);
+  if (!dir)
+    return 0;
+
+  int node = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)))
+    if (   strncmp(entry->d_name, "node", 4) == 0
+        && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+      node = atoi(entry->d_name + 4);
+      break;
+    }
+  closedir(dir);
+
+  return node;
+}
+
+// cpu_l3() returns the lowest cpu that shares the last cache of level 3
+// with the given cpu, or the cpu itself if it has no L3 cache.
+
+static int cpu_l3(int cpu, int *list, int max)
+{
+  char name[96];
+  for (int index = 0; ; index++) {
+    sprintf(name, "/sys/devices/system/cpu/cpu%d/cache/index%d/level",
+            cpu, index);
+    int level = read_int(name, -1);
+    if (level < 0)
+      return cpu;
+    if (level != 3)
+      continue;
+    sprintf(name,
+            "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",
+            cpu, index);
+    int n = read_cpu_list(name, list, max);
+    int lowest = cpu;
+    for (int i = 0; i < n; i++)
+      lowest = min(lowest, list[i]);
+    return lowest;
+  }
+}
+
+// Threads are placed on cpus in this order: first one per physical core,
+// going through the cores node by node and L3 domain by L3 domain, then
+// the second SMT siblings in the same order, and so on.
+
+static int cpu_compare(const void *a, const void *b)
+{
+  const CpuInfo *x = a, *y = b;
+
+  if (x->smt != y->smt)   return x->smt - y->smt;
+  if (x->node != y->node) return x->node - y->node;
+  if (x->l3 != y->l3)     return x->l3 - y->l3;
+  return x->core - y->core;
+}
+
+void topology_init(void)
+{
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed))
+    return;
+
+  int max_cpus = CPU_SETSIZE;
+  int *online = malloc(max_cpus * sizeof(int));
+  int *list = malloc(max_cpus * sizeof(int));
+  int *l3_keys = malloc(max_cpus * sizeof(int));
+  int num_l3 = 0;
+  char name[96];
+
+  int n = read_cpu_list("/sys/devices/system/cpu/online", online, max_cpus);
+  cpus = malloc(n * sizeof(CpuInfo));
+  num_cpus = num_cores = 0;
+
+  // Only the cpus we are allowed to run on count, which matters inside
+  // containers and under taskset.
+  for (int i = 0; i < n; i++) {
+    int cpu = online[i];
+    if (!CPU_ISSET(cpu, &allowed))
+      continue;
+
+    CpuInfo *ci = &cpus[num_cpus++];
+    ci->cpu = cpu;
+    ci->node = cpu_node(cpu);
+
+    sprintf(name,
+            "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    int m = read_cpu_list(name, list, max_cpus);
+    ci->core = cpu;
+    ci->smt = 0;
+    for (int j = 0; j < m; j++) {
+      ci->core = min(ci->core, list[j]);
+      ci->smt += list[j] < cpu;
+    }
+    num_cores += ci->smt == 0;
+
+    int key = cpu_l3(cpu, list, max_cpus);
+    for (ci->l3 = 0; ci->l3 < num_l3; ci->l3++)
+      if (l3_keys[ci->l3] == key)
+        break;
+    if (ci->l3 == num_l3)
+      l3_keys[num_l3++] = key;
+  }
+
+  qsort(cpus, num_cpus, sizeof(CpuInfo), cpu_compare);
+
+  free(online);
+  free(list);
+  free(l3_keys);
+}
+
+void topology_exit(void)
+{
+  free(cpus);
+  cpus = NULL;
+  num_cpus = num_cores = 0;
+}
+
+int topology_num_cpus(void)
+{
+  return num_cpus;
+}
+
+int topology_num_cores(void)
+{
+  return num_cores;
+}
+
+// topology_bind_thread() binds the calling thread, search thread number
+// idx, to a single cpu. With NUMA enabled, only cpus of the selected nodes
+// are used and memory is preferably taken from the node of the cpu. It
+// returns 0 if the thread could not be bound.
+
+int topology_bind_thread(int idx, int *node, int *l3)
+{
+  int n = 0;
+  for (int i = 0; i < num_cpus; i++) {
+#ifdef NUMA
+    if (   settings.numa_enabled
+        && !numa_bitmask_isbitset(settings.mask, cpus[i].node))
+      continue;
+#endif
+    n++;
+  }
+  if (n == 0)
+    return 0;
+
+  int k = idx % n;
+  CpuInfo *ci = NULL;
+  for (int i = 0; i < num_cpus; i++) {
+#ifdef NUMA
+    if (   settings.numa_enabled
+        && !numa_bitmask_isbitset(settings.mask, cpus[i].node))
+      continue;
+#endif
+    if (k-- == 0) {
+      ci = &cpus[i];
+      break;
+    }
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(ci->cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+    return 0;
+
+  printf("info string Binding thread %d to cpu %d.\n", idx, ci->cpu);
+  fflush(stdout);
+
+#ifdef NUMA
+  if (settings.numa_enabled)
+    numa_set_preferred(ci->node);
+#endif
+
+  *node = ci->node;
+  *l3 = ci->l3;
+
+  return 1;
+}
+
+// cgroup_read() reads the first line of a control file of the cgroup we
+// belong to. It looks at the cgroup v1 hierarchy of the given controller
+// first and then at the unified v2 hierarchy. The file is looked for in
+// our own cgroup and then at the root of the mount, which is what a
+// container with its own cgroup namespace sees.
+
+static int cgroup_read(const char *controller, const char *v1_file,
+                       const char *v2_file, char *buf, int size)
+{
+  FILE *F = fopen("/proc/self/cgroup", "r");
+  if (!F)
+    return 0;
+
+  char line[512], v1_dir[128] = "", v1_path[384] = "", v2_path[384] = "";
+  while (fgets(line, sizeof(line), F)) {
+    char *controllers = strchr(line, ':');
+    char *path = controllers ? strchr(controllers + 1, ':') : NULL;
+    if (!path)
+      continue;
+    *path++ = 0;
+    controllers++;
+    path[strcspn(path, "\n")] = 0;
+    if (!*controllers)
+      snprintf(v2_path, sizeof(v2_path), "%s", path);
+    else {
+      // Match the controller in a list like "cpu,cpuacct".
+      char list[128];
+      snprintf(list, sizeof(list), ",%s,", controllers);
+      char key[64];
+      snprintf(key, sizeof(key), ",%s,", controller);
+      if (strstr(list, key)) {
+        snprintf(v1_dir, sizeof(v1_dir), "%s", controllers);
+        snprintf(v1_path, sizeof(v1_path), "%s", path);
+      }
+    }
+  }
+  fclose(F);
+
+  char name[1024];
+  const char *tries[4][3] = {
+    { v1_dir, v1_path, v1_file }, { v1_dir, "", v1_file },
+    { "", v2_path, v2_file }, { "", "", v2_file }
+  };
+  for (int i = 0; i < 4; i++) {
+    if (!tries[i][2] || (i < 2 && !*v1_dir))
+      continue;
+    snprintf(name, sizeof(name), "/sys/fs/cgroup/%s/%s/%s",
+             tries[i][0], tries[i][1], tries[i][2]);
+    if ((F = fopen(name, "r"))) {
+      int ok = fgets(buf, size, F) != NULL;
+      fclose(F);
+      if (ok)
+        return 1;
+    }
+  }
+
+  return 0;
+}
+
+// topology_cpu_limit() returns how many threads can run at the same time
+// without being throttled: the number of cpus in our affinity mask,
+// lowered to the cgroup cpu quota rounded down.
+
+int topology_cpu_limit(void)
+{
+  int limit = num_cpus;
+  char buf[128];
+  long long quota, period;
+
+  // In v2, cpu.max holds "quota period" with "max" for no quota. In v1,
+  // the quota is -1 if there is none and the period is in its own file.
+  if (!cgroup_read("cpu", "cpu.cfs_quota_us", "cpu.max", buf, sizeof(buf)))
+    return limit;
+  int n = sscanf(buf, "%lld %lld", &quota, &period);
+  if (n == 1) {
+    if (!cgroup_read("cpu", "cpu.cfs_period_us", NULL, buf, sizeof(buf)))
+      return limit;
+    period = atoll(buf);
+  }
+  if (n >= 1 && quota > 0 && period > 0)
+    limit = min(limit, (int)max(quota / period, 1));
+
+  return limit;
+}
+
+// topology_memory_limit() returns the number of bytes of memory we may
+// use: the cgroup memory limit, if any, but no more than the physical
+// memory of the machine.
+
+uint64_t topology_memory_limit(void)
+{
+  uint64_t limit =  (uint64_t)sysconf(_SC_PHYS_PAGES)
+                  * (uint64_t)sysconf(_SC_PAGE_SIZE);
+  char buf[128];
+
+  if (   cgroup_read("memory", "memory.limit_in_bytes", "memory.max",
+                     buf, sizeof(buf))
+      && buf[0] >= '0' && buf[0] <= '9')
+    limit = min(limit, strtoull(buf, NULL, 10));
+
+  return limit;
+}
+
+#else
+
+int topology_cpu_limit(void) { return 0; }
+uint64_t topology_memory_limit(void) { return 0; }
+void topology_init(void) {}
+void topology_exit(void) {}
+int topology_num_cpus(void) { return 0; }
+int topology_num_cores(void) { return 0; }
+
+int topology_bind_thread(int idx, int *node, int *l3)
+{
+  (void)idx, (void)node, (void)l3;
+  return 0;
+}
+
+#endif
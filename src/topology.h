@@ -0,0 +1,20 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdint.h>
+
+// The cache topology tells which logical cpus are SMT siblings of one
+// physical core, which cores share an L3 cache and on which NUMA node
+// each cpu sits. On Linux it is read from sysfs, as are the cpu and memory
+// limits of our cgroup. On other systems nothing is known, threads are not
+// bound and the limits are 0.
+
+void topology_init(void);
+void topology_exit(void);
+int topology_num_cpus(void);
+int topology_num_cores(void);
+int topology_bind_thread(int idx, int *node, int *l3);
+int topology_cpu_limit(void);
+uint64_t topology_memory_limit(void);
+
+#endif
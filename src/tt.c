@@ -20,57 +20,159 @@
 
 #define _GNU_SOURCE
 
+#include <errno.h>
+#include <inttypes.h>
 #include <string.h>   // For std::memset
 #include <stdio.h>
 #ifndef __WIN32__
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #include "bitboard.h"
+#include "engine.h"
 #include "numa.h"
+#include "position.h"
 #include "settings.h"
+#include "thread.h"
 #include "tt.h"
 #include "types.h"
 #include "uci.h"
 
-TranspositionTable TT; // Our global transposition table
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
 
-// tt_free() frees the allocated transposition table memory.
+// tt_print_large_pages() reports how much of the transposition table is
+// backed by huge pages, as found in /proc/self/smaps. Explicit huge pages
+// are reserved when the table is allocated, whereas transparent huge pages
+// only appear as the search touches the table.
+
+void tt_print_large_pages(TranspositionTable *tt)
+{
+#ifdef __linux__
+  FILE *F;
+  if (!tt->mem || !(F = fopen("/proc/self/smaps", "r")))
+    return;
+
+  uintptr_t begin = (uintptr_t)tt->table;
+  uintptr_t end = begin + tt->clusterCount * sizeof(Cluster);
+  uintptr_t start, stop;
+  int inside = 0;
+  size_t kb, backed = 0;
+  char line[256];
+
+  while (fgets(line, sizeof(line), F)) {
+    if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR, &start, &stop) == 2)
+      inside = start < end && stop > begin;
+    else if (inside && (   sscanf(line, "AnonHugePages: %zu", &kb) == 1
+                        || sscanf(line, "Private_Hugetlb: %zu", &kb) == 1
+                        || sscanf(line, "Shared_Hugetlb: %zu", &kb) == 1))
+      backed += kb;
+  }
+  fclose(F);
+
+  printf("info string Transposition table: %" FMT_Z "uMB of %" FMT_Z "uMB "
+         "backed by %s.\n", backed / 1024, (size_t)(end - begin) >> 20,
+         tt->hugePageShift == 30 ? "1GB pages"
+         : tt->hugePageShift == 21 ? "2MB pages" : "transparent huge pages");
+  fflush(stdout);
+#endif
+}
+
+
+// tt_free_mem() releases a table allocation made by tt_allocate() or
+// tt_load().
 
-void tt_free(void)
+static void tt_free_mem(void *mem, size_t alloc_size)
 {
 #ifdef __WIN32__
-  if (TT.mem)
-    VirtualFree(TT.mem, 0, MEM_RELEASE);
+  (void)alloc_size;
+  if (mem)
+    VirtualFree(mem, 0, MEM_RELEASE);
 #else
-  if (TT.mem)
-    munmap(TT.mem, TT.alloc_size);
+  if (mem)
+    munmap(mem, alloc_size);
+#endif
+}
+
+
+// tt_reset_full_keys() allocates a zeroed full key array for the current
+// table. A zero full key marks an entry whose key is unknown.
+
+static void tt_reset_full_keys(TranspositionTable *tt)
+{
+  (void)tt;
+
+#ifdef TT_FULLKEYS
+  free(tt->fullKeys);
+  tt->fullKeys = calloc(tt->clusterCount * ClusterSize, sizeof(Key));
+  if (!tt->fullKeys) {
+    fprintf(stderr, "Failed to allocate full keys.\n");
+    exit(EXIT_FAILURE);
+  }
+#endif
+}
+
+
+// tt_free() frees the allocated transposition table memory.
+
+#ifndef __WIN32__
+static int tt_attach_shared(TranspositionTable *tt, size_t count);
+static void tt_detach_shared(TranspositionTable *tt);
+#endif
+
+void tt_free(TranspositionTable *tt)
+{
+#ifdef TT_FULLKEYS
+  free(tt->fullKeys);
+  tt->fullKeys = NULL;
 #endif
-  TT.mem = NULL;
+#ifndef __WIN32__
+  if (tt->sharedGeneration8) {
+    tt_detach_shared(tt);
+    return;
+  }
+#endif
+  tt_free_mem(tt->mem, tt->alloc_size);
+  tt->mem = NULL;
 }
 
 
 // tt_allocate() allocates the transposition table, measured in 
 // megabytes.
 
-void tt_allocate(size_t mbSize)
+void tt_allocate(TranspositionTable *tt, size_t mbSize)
 {
-  size_t count = ((size_t)1) << msb((mbSize * 1024 * 1024) / sizeof(Cluster));
+  size_t count = (mbSize * 1024 * 1024) / sizeof(Cluster);
 
-  TT.clusterCount = count;
+  tt->clusterCount = count;
+  tt->cleared = 1; // Fresh pages from the OS are zero
 
   size_t size = count * sizeof(Cluster);
 
+#ifndef __WIN32__
+  if (settings.shm_name[0]) {
+    if (!tt_attach_shared(tt, count))
+      return;
+    printf("info string Unable to attach to shared hash %s.\n",
+           settings.shm_name);
+    fflush(stdout);
+  }
+#endif
+
 #ifdef __WIN32__
 
-  TT.mem = NULL;
+  tt->mem = NULL;
   if (settings.large_pages) {
     size_t page_size = large_page_minimum;
     size_t lp_size = (size + page_size - 1) & ~(page_size - 1);
-    TT.mem = VirtualAlloc(NULL, lp_size,
+    tt->mem = VirtualAlloc(NULL, lp_size,
                           MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES,
                           PAGE_READWRITE);
-    if (!TT.mem)
+    if (!tt->mem)
       printf("info string Unable to allocate large pages for the "
              "transposition table.\n");
     else
@@ -78,11 +180,11 @@ void tt_allocate(size_t mbSize)
     fflush(stdout);
   }
 
-  if (!TT.mem)
-    TT.mem = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-  if (!TT.mem)
+  if (!tt->mem)
+    tt->mem = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+  if (!tt->mem)
     goto failed;
-  TT.table = (Cluster *)TT.mem;
+  tt->table = (Cluster *)tt->mem;
 
 #else /* Unix */
 
@@ -92,29 +194,57 @@ void tt_allocate(size_t mbSize)
 #ifdef __APPLE__
 
   if (settings.large_pages) {
-    TT.mem = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
+    tt->mem = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
                   MAP_PRIVATE | MAP_ANONYMOUS, VM_SUPERPAGE_SIZE_2MB, 0);
-    if (!TT.mem)
+    if (!tt->mem)
       printf("info string Unable to allocate large pages for the "
              "transposition table.\n");
     else
       printf("info string Transposition table allocated using large pages.\n");
     fflush(stdout);
   }
-  if (!TT.mem)
-    TT.mem = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
+  if (!tt->mem)
+    tt->mem = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 #else
 
-  TT.mem = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
+  tt->mem = NULL;
+  tt->hugePageShift = 0;
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+
+  // Try explicit huge pages first: 1GB pages for tables of at least 1GB,
+  // then 2MB pages. They come from the pool the administrator reserved
+  // through vm.nr_hugepages or the hugepages= boot parameter. Failing
+  // that, we fall back to transparent huge pages below.
+  if (settings.large_pages)
+    for (int shift = size >= (1ULL << 30) ? 30 : 21; shift >= 21; shift -= 9) {
+      size_t page_size = (size_t)1 << shift;
+      size_t hp_size = (size + page_size - 1) & ~(page_size - 1);
+      void *mem = mmap(NULL, hp_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB
+                       | (shift << MAP_HUGE_SHIFT), -1, 0);
+      if (mem != MAP_FAILED) {
+        tt->mem = mem;
+        tt->hugePageShift = shift;
+        alloc_size = hp_size;
+        break;
+      }
+    }
+
+  if (!tt->mem)
+#endif
+  tt->mem = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (tt->mem == MAP_FAILED)
+    tt->mem = NULL;
 
 #endif
 
-  TT.alloc_size = alloc_size;
-  TT.table = (Cluster *)(  (((uintptr_t)TT.mem) + alignment - 1)
+  tt->alloc_size = alloc_size;
+  tt->table = (Cluster *)(  (((uintptr_t)tt->mem) + alignment - 1)
                          & ~(alignment - 1));
-  if (!TT.mem)
+  if (!tt->mem)
     goto failed;
 
 #ifdef NUMA
@@ -122,21 +252,25 @@ void tt_allocate(size_t mbSize)
   // Create an interleave mask of the nodes on which threads are
   // actually running?
   if (settings.numa_enabled)
-    numa_interleave_memory(TT.table, count * sizeof(Cluster), settings.mask);
+    numa_interleave_memory(tt->table, count * sizeof(Cluster), settings.mask);
 #endif
 
 #ifdef __linux__
 #ifdef MADV_HUGEPAGE
 
   // Advise the kernel to allocate large pages.
-  if (settings.large_pages)
-    madvise(TT.table, count * sizeof(Cluster), MADV_HUGEPAGE);
+  if (settings.large_pages && !tt->hugePageShift)
+    madvise(tt->table, count * sizeof(Cluster), MADV_HUGEPAGE);
 
 #endif
+
+  if (settings.large_pages)
+    tt_print_large_pages(tt);
 #endif
 
 #endif
 
+  tt_reset_full_keys(tt);
   return;
 
 
@@ -147,49 +281,478 @@ failed:
 }
 
 
+// Relative value of an entry for the replacement strategy: its depth minus
+// 8 times its age. Due to our packed storage format for generation and its
+// cyclic nature we add 259 (256 is the modulus plus 3 to keep the lowest
+// two bound bits from affecting the result) to calculate the entry age
+// correctly even after generation8 overflows into the next cycle.
+
+INLINE int tte_relative_value(const TTEntry *tte, uint8_t generation8)
+{
+  return tte->depth8 - ((259 + generation8 - tte->genBound8) & 0xFC) * 2;
+}
+
+
+// tt_resize() changes the size of the transposition table while keeping
+// its contents. The search threads migrate the entries of the old table
+// into the newly allocated one in parallel, see tt_migrate() below.
+
+static void tt_migrate(Pos *pos);
+
+void tt_resize(Engine *engine, size_t mbSize)
+{
+  TranspositionTable *tt = &engine->tt;
+
+  // A shared table belongs to all attached engines, so we do not copy it
+  // into a private table or the other way around.
+  if (!tt->mem || tt->sharedGeneration8 || settings.shm_name[0]) {
+    tt_free(tt);
+    tt_allocate(tt, mbSize);
+    return;
+  }
+
+  void *oldMem = tt->mem;
+  size_t oldAllocSize = tt->alloc_size;
+  tt->oldTable = tt->table;
+  tt->oldClusterCount = tt->clusterCount;
+
+  tt->mem = NULL;
+  tt_allocate(tt, mbSize);
+  threads_run(engine, tt_migrate);
+  tt->cleared = 0;
+
+  tt_free_mem(oldMem, oldAllocSize);
+}
+
+
+// tt_migrate() fills this thread's share of the new table. Old cluster i
+// holds the keys whose index fraction lies in [i / old, (i + 1) / old), so
+// new cluster j can only take entries of the old clusters overlapping
+// [j / new, (j + 1) / new). When the table grows, an old cluster is copied
+// to all new clusters it overlaps, as the extra index bits are unknown.
+// When it shrinks, the deepest and newest entries of the merged clusters
+// are kept.
+
+INLINE size_t muldiv(size_t a, size_t b, size_t c)
+{
+#ifdef IS_64BIT
+  return (size_t)((uint128_t)a * b / c);
+#else
+  return (size_t)((uint64_t)a * b / c);
+#endif
+}
+
+static void tt_migrate(Pos *pos)
+{
+  TranspositionTable *tt = &pos->engine->tt;
+  size_t num = pos->engine->threads.num_threads;
+  size_t oldClusterCount = tt->oldClusterCount;
+  uint8_t g = tt->generation8;
+  size_t begin = tt->clusterCount * pos->thread_idx / num;
+  size_t end = tt->clusterCount * (pos->thread_idx + 1) / num;
+
+  for (size_t j = begin; j < end; j++) {
+    TTEntry *tte = tt->table[j].entry;
+    size_t first = muldiv(j, oldClusterCount, tt->clusterCount);
+    size_t last = muldiv(j + 1, oldClusterCount, tt->clusterCount);
+    int cnt = 0;
+
+    // Old cluster 'last' overlaps only if the boundary falls inside it.
+    if (muldiv(last, tt->clusterCount, oldClusterCount) > j)
+      last--;
+    last = min(last, oldClusterCount - 1);
+
+    for (size_t i = first; i <= last; i++)
+      for (int k = 0; k < ClusterSize; k++) {
+        TTEntry *e = &tt->oldTable[i].entry[k];
+        if (!tte_key(e))
+          continue;
+
+        if (cnt < ClusterSize) {
+          tte[cnt++] = *e;
+          continue;
+        }
+
+        TTEntry *replace = tte;
+        for (int l = 1; l < ClusterSize; l++)
+          if (tte_relative_value(replace, g) > tte_relative_value(&tte[l], g))
+            replace = &tte[l];
+        if (tte_relative_value(e, g) > tte_relative_value(replace, g))
+          *replace = *e;
+      }
+  }
+}
+
+
+// A hash file starts with a header padded to TTFileHeaderSize bytes,
+// followed by the clusters exactly as they are laid out in memory. The
+// header records the layout, so that a file is never loaded into an engine
+// built with an incompatible TTEntry format.
+
+#define TTFileHeaderSize 4096
+
+static const char TTFileMagic[8] = "CfishTT";
+
+struct TTFileHeader {
+  char magic[8];
+  uint64_t clusterCount;
+  uint32_t clusterSize;
+  uint32_t lockless;
+  uint8_t generation8;
+};
+
+typedef struct TTFileHeader TTFileHeader;
+
+static void tt_file_header(TranspositionTable *tt, TTFileHeader *h)
+{
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, TTFileMagic, sizeof(TTFileMagic));
+  h->clusterCount = tt->clusterCount;
+  h->clusterSize = sizeof(Cluster);
+#ifdef TT_LOCKLESS
+  h->lockless = 1;
+#endif
+  h->generation8 = tt->generation8;
+}
+
+// tt_file_header_ok() checks a header read from a hash file against the
+// layout of our table. The file must hold at least one cluster, and not so
+// many that its size overflows a size_t.
+
+static int tt_file_header_ok(TranspositionTable *tt, const TTFileHeader *h)
+{
+  TTFileHeader ref;
+  tt_file_header(tt, &ref);
+
+  return   !memcmp(h->magic, TTFileMagic, sizeof(TTFileMagic))
+        && h->clusterSize == ref.clusterSize
+        && h->lockless == ref.lockless
+        && h->clusterCount > 0
+        && h->clusterCount <= (SIZE_MAX - TTFileHeaderSize) / sizeof(Cluster);
+}
+
+
+// tt_save() writes the transposition table including its generation to
+// the given file. It returns 0 on success.
+
+int tt_save(TranspositionTable *tt, const char *fname)
+{
+  char header[TTFileHeaderSize];
+  FILE *F = fopen(fname, "wb");
+  if (!F)
+    return 1;
+
+  memset(header, 0, TTFileHeaderSize);
+  tt_file_header(tt, (TTFileHeader *)header);
+
+  int ok =   fwrite(header, TTFileHeaderSize, 1, F) == 1
+          && fwrite(tt->table, sizeof(Cluster), tt->clusterCount, F)
+                                                     == tt->clusterCount;
+  return (fclose(F) != 0) | !ok;
+}
+
+
+// tt_load() replaces the transposition table by the contents of the given
+// file. On Unix the file is mapped copy-on-write straight into the table
+// region, so pages are brought in lazily as the search touches them and
+// nothing is written back to the file. It returns 0 on success.
+
+int tt_load(TranspositionTable *tt, const char *fname)
+{
+  TTFileHeader h;
+
+#ifndef __WIN32__
+
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0)
+    return 1;
+
+  struct stat st;
+  if (   fstat(fd, &st) < 0
+      || read(fd, &h, sizeof(h)) != sizeof(h)) {
+    close(fd);
+    return 1;
+  }
+
+  if (   !tt_file_header_ok(tt, &h)
+      || (uint64_t)st.st_size != TTFileHeaderSize + h.clusterCount * sizeof(Cluster)) {
+    close(fd);
+    return 1;
+  }
+
+  void *mem = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                   fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED)
+    return 1;
+
+#ifdef MADV_WILLNEED
+  // Start reading the file in the background.
+  madvise(mem, st.st_size, MADV_WILLNEED);
+#endif
+
+  tt_free(tt);
+  tt->mem = mem;
+  tt->alloc_size = st.st_size;
+  tt->table = (Cluster *)((char *)mem + TTFileHeaderSize);
+
+#else
+
+  FILE *F = fopen(fname, "rb");
+  if (!F)
+    return 1;
+
+  if (   fread(&h, sizeof(h), 1, F) != 1
+      || !tt_file_header_ok(tt, &h)
+      || fseek(F, TTFileHeaderSize, SEEK_SET)) {
+    fclose(F);
+    return 1;
+  }
+
+  size_t size = h.clusterCount * sizeof(Cluster);
+  void *mem = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE,
+                           PAGE_READWRITE);
+  if (!mem || fread(mem, sizeof(Cluster), h.clusterCount, F) != h.clusterCount) {
+    if (mem)
+      VirtualFree(mem, 0, MEM_RELEASE);
+    fclose(F);
+    return 1;
+  }
+  fclose(F);
+
+  tt_free(tt);
+  tt->mem = mem;
+  tt->table = (Cluster *)mem;
+
+#endif
+
+  tt->clusterCount = h.clusterCount;
+  tt->generation8 = h.generation8;
+  tt->cleared = 0;
+  tt->hugePageShift = 0;
+  tt_reset_full_keys(tt);
+
+  return 0;
+}
+
+
+#ifndef __WIN32__
+
+// A shared hash lives in a named POSIX shared memory segment, so that
+// engines running on the same machine search with a common table. The
+// segment is laid out like a hash file, with the header extended by the
+// number of attached engines and the generation, which is advanced by the
+// new search of any of them. The first engine creates the segment with its
+// Hash size and later ones attach to it at whatever size it has. The last
+// one to detach removes it.
+
+struct TTShmHeader {
+  TTFileHeader file;
+  atomic_int ready;
+  atomic_int attached;
+  atomic_uchar generation8;
+};
+
+typedef struct TTShmHeader TTShmHeader;
+
+// tt_map_shared_header() waits for the engine that created the segment to
+// initialise its header and checks that the table layout matches ours.
+// It returns the size of the segment, or 0 on failure.
+
+static size_t tt_map_shared_header(TranspositionTable *tt, int fd)
+{
+  struct stat st;
+  size_t size = 0;
+
+  for (int i = 0; i < 1000; i++) {
+    if (fstat(fd, &st))
+      return 0;
+    if ((size_t)st.st_size >= TTFileHeaderSize)
+      break;
+    usleep(1000);
+  }
+  if ((size_t)st.st_size < TTFileHeaderSize)
+    return 0;
+
+  TTShmHeader *h = mmap(NULL, TTFileHeaderSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+  if (h == MAP_FAILED)
+    return 0;
+
+  for (int i = 0; i < 1000 && !atomic_load(&h->ready); i++)
+    usleep(1000);
+
+  if (   atomic_load(&h->ready)
+      && tt_file_header_ok(tt, &h->file)
+      && (size_t)st.st_size >= TTFileHeaderSize + h->file.clusterCount * sizeof(Cluster))
+    size = TTFileHeaderSize + h->file.clusterCount * sizeof(Cluster);
+
+  munmap(h, TTFileHeaderSize);
+  return size;
+}
+
+// tt_attach_shared() creates the shared hash named by the "Shared Hash"
+// option with count clusters, or attaches to it if it already exists. It
+// returns 0 on success.
+
+static int tt_attach_shared(TranspositionTable *tt, size_t count)
+{
+  char *shmName = tt->shmName;
+
+  snprintf(shmName, sizeof(tt->shmName), "%s%s",
+           settings.shm_name[0] == '/' ? "" : "/", settings.shm_name);
+
+  int created = 1;
+  int fd = shm_open(shmName, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    created = 0;
+    fd = shm_open(shmName, O_RDWR, 0);
+  }
+  if (fd < 0)
+    return 1;
+
+  size_t size =  created ? TTFileHeaderSize + count * sizeof(Cluster)
+               : tt_map_shared_header(tt, fd);
+  TTShmHeader *h = MAP_FAILED;
+  if (size && (!created || !ftruncate(fd, size)))
+    h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (h == MAP_FAILED) {
+    if (created)
+      shm_unlink(shmName);
+    return 1;
+  }
+
+  if (created) {
+    tt->clusterCount = count;
+    tt->generation8 = 0;
+    tt_file_header(tt, &h->file);
+    atomic_store(&h->attached, 1);
+    atomic_store(&h->ready, 1);
+  } else {
+    tt->clusterCount = h->file.clusterCount;
+    atomic_fetch_add(&h->attached, 1);
+  }
+
+  tt->shmHeader = h;
+  tt->mem = h;
+  tt->alloc_size = size;
+  tt->table = (Cluster *)((char *)h + TTFileHeaderSize);
+  tt->sharedGeneration8 = &h->generation8;
+  tt->generation8 = atomic_load(&h->generation8);
+  tt->cleared = created;
+  tt->hugePageShift = 0;
+  tt_reset_full_keys(tt);
+
+#ifdef MADV_HUGEPAGE
+  if (settings.large_pages)
+    madvise(tt->table, tt->clusterCount * sizeof(Cluster), MADV_HUGEPAGE);
+#endif
+
+  printf("info string %s shared hash %s of %" FMT_Z "uMB.\n",
+         created ? "Created" : "Attached to", shmName,
+         (tt->clusterCount * sizeof(Cluster)) >> 20);
+  fflush(stdout);
+
+  return 0;
+}
+
+static void tt_detach_shared(TranspositionTable *tt)
+{
+  if (atomic_fetch_sub(&tt->shmHeader->attached, 1) == 1)
+    shm_unlink(tt->shmName);
+  munmap(tt->mem, tt->alloc_size);
+  tt->shmHeader = NULL;
+  tt->sharedGeneration8 = NULL;
+  tt->mem = NULL;
+}
+
+#endif
+
+
 // tt_clear() overwrites the entire transposition table with zeros. It
-// is called whenever the table is resized, or when the user asks the
-// program to clear the table (from the UCI interface).
+// is called when the user asks the program to clear the table (from the
+// UCI interface). The work is split over the search threads, so that a
+// large table is cleared in parallel and, with NUMA enabled, each slice
+// is faulted in by a thread bound to a node of the table's node mask.
+// A table that has not been written to since tt_allocate() handed out
+// fresh zero pages is left alone.
+
+static void tt_clear_worker(Pos *pos)
+{
+  TranspositionTable *tt = &pos->engine->tt;
+  size_t num = pos->engine->threads.num_threads;
+  size_t begin = tt->clusterCount * pos->thread_idx / num;
+  size_t end = tt->clusterCount * (pos->thread_idx + 1) / num;
+
+  memset(&tt->table[begin], 0, (end - begin) * sizeof(Cluster));
+}
 
-void tt_clear(void)
+void tt_clear(Engine *engine)
 {
-  memset(TT.table, 0, TT.clusterCount * sizeof(Cluster));
+  TranspositionTable *tt = &engine->tt;
+
+  // Other engines may be searching with a shared table.
+  if (tt->cleared || tt->sharedGeneration8)
+    return;
+
+  threads_run(engine, tt_clear_worker);
+  tt_reset_full_keys(tt);
+  tt->cleared = 1;
 }
 
 
 // tt_probe() looks up the current position in the transposition table.
-// It returns true and a pointer to the TTEntry if the position is found.
-// Otherwise, it returns false and a pointer to an empty or least valuable
-// TTEntry to be replaced later. The replace value of an entry is
-// calculated as its depth minus 8 times its relative age. TTEntry t1 is
-// considered more valuable than TTEntry t2 if its replace value is greater
-// than that of t2.
-
-TTEntry *tt_probe(Key key, int *found)
-{
-  TTEntry *tte = tt_first_entry(key);
-  uint16_t key16 = key >> 48; // Use the high 16 bits as key inside the cluster
-
-  for (int i = 0; i < ClusterSize; i++)
-    if (!tte[i].key16 || tte[i].key16 == key16) {
-      if ((tte[i].genBound8 & 0xFC) != TT.generation8 && tte[i].key16)
-        tte[i].genBound8 = (uint8_t)(TT.generation8 | tte_bound(&tte[i])); // Refresh
-      *found = (int)tte[i].key16;
+// It returns true and a pointer to the TTEntry if the position is found,
+// with a copy of the entry as it was verified in *data. The caller reads
+// the entry only through that copy. Otherwise, it returns false and a
+// pointer to an empty or least valuable TTEntry to be replaced later.
+// The replace value of an entry is calculated as its depth minus 8 times
+// its relative age. TTEntry t1 is considered more valuable than TTEntry t2
+// if its replace value is greater than that of t2.
+
+TTEntry *tt_probe_stats(TranspositionTable *tt, Key key, int *found,
+                        TTEntry *data TT_STATS_ARG)
+{
+  TTEntry *tte = tt_first_entry(tt, key);
+  TTKey keyBits = tt_key_bits(key); // Key bits not used by the cluster index
+
+  tt_stat(probes);
+
+  for (int i = 0; i < ClusterSize; i++) {
+    TTEntry e = tte[i];
+    TTKey k = tte_key(&e);
+    if (!k || k == keyBits) {
+      if ((e.genBound8 & 0xFC) != tt->generation8 && k) {
+        e.genBound8 = (uint8_t)(tt->generation8 | tte_bound(&e));
+        tte[i].genBound8 = e.genBound8; // Refresh
+        tt_stat(refreshes);
+      }
+      if (k) {
+        tt_stat(hits);
+#ifdef TT_FULLKEYS
+        Key full = *tte_full_key(tt, &tte[i]);
+        if (full && full != key)
+          tt_stat(collisions);
+#endif
+      } else
+        tt_stat(emptyHits);
+      *found = !!k;
+      *data = e;
       return &tte[i];
     }
+  }
 
   // Find an entry to be replaced according to the replacement strategy
   TTEntry* replace = tte;
   for (int i = 1; i < ClusterSize; i++)
-    // Due to our packed storage format for generation and its cyclic
-    // nature we add 259 (256 is the modulus plus 3 to keep the lowest
-    // two bound bits from affecting the result) to calculate the entry
-    // age correctly even after generation8 overflows into the next cycle.
-    if (  replace->depth8 - ((259 + TT.generation8 - replace->genBound8) & 0xFC) * 2
-        >   tte[i].depth8 - ((259 + TT.generation8 -   tte[i].genBound8) & 0xFC) * 2)
+    if (  tte_relative_value(replace, tt->generation8)
+        > tte_relative_value(&tte[i], tt->generation8))
       replace = &tte[i];
 
   *found = 0;
+  memset(data, 0, sizeof(TTEntry));
   return replace;
 }
 
@@ -197,15 +760,77 @@ TTEntry *tt_probe(Key key, int *found)
 // Returns an approximation of the hashtable occupation during a search. The
 // hash is x permill full, as per UCI protocol.
 
-int tt_hashfull(void)
+int tt_hashfull(TranspositionTable *tt)
 {
   int cnt = 0;
   for (int i = 0; i < 1000 / ClusterSize; i++) {
-    const TTEntry *tte = &TT.table[i].entry[0];
+    const TTEntry *tte = &tt->table[i].entry[0];
     for (int j = 0; j < ClusterSize; j++)
-      if ((tte[j].genBound8 & 0xFC) == TT.generation8)
+      if ((tte[j].genBound8 & 0xFC) == tt->generation8)
         cnt++;
   }
   return cnt;
 }
 
+
+// tt_print_stats() prints the probe and save counters summed over all
+// threads since the last ucinewgame, if compiled in, and the occupancy of
+// the table by the age of its entries, sampled over its first clusters.
+
+void tt_print_stats(Engine *engine, FILE *F)
+{
+  TranspositionTable *tt = &engine->tt;
+  size_t sample = min(tt->clusterCount, (size_t)1 << 16);
+  uint64_t age[5] = { 0 };
+
+  for (size_t i = 0; i < sample; i++)
+    for (int j = 0; j < ClusterSize; j++) {
+      const TTEntry *tte = &tt->table[i].entry[j];
+      if (!tte_key(tte))
+        age[4]++;
+      else
+        age[min(((uint8_t)(tt->generation8 - (tte->genBound8 & 0xFC))) >> 2, 3)]++;
+    }
+
+  double n = (double)(sample * ClusterSize) / 100;
+  fprintf(F, "\nTransposition table: %" FMT_Z "u clusters of %d entries\n"
+             "Entries by age  : %.1f%% %.1f%% %.1f%% %.1f%% (0, 1, 2, 3+ searches)"
+             ", %.1f%% empty\n", tt->clusterCount, ClusterSize,
+             age[0] / n, age[1] / n, age[2] / n, age[3] / n, age[4] / n);
+
+#ifdef TT_STATS
+  TTStats t = { 0 };
+  for (size_t idx = 0; idx < engine->threads.num_threads; idx++) {
+    const TTStats *s = &engine->threads.pos[idx]->ttStats;
+    t.probes += s->probes;
+    t.hits += s->hits;
+    t.emptyHits += s->emptyHits;
+    t.refreshes += s->refreshes;
+    t.saves += s->saves;
+    t.replaced += s->replaced;
+    t.deeper += s->deeper;
+    t.collisions += s->collisions;
+  }
+
+  double p = t.probes ? (double)t.probes / 100 : 1;
+  double h = t.hits ? (double)t.hits / 1000000 : 1;
+  fprintf(F, "Probes          : %" PRIu64 "\n"
+             "Hits            : %" PRIu64 " (%.1f%%)\n"
+             "Misses, empty   : %" PRIu64 " (%.1f%%)\n"
+             "Misses, full    : %" PRIu64 " (%.1f%%)\n"
+             "Refreshes       : %" PRIu64 "\n"
+             "Saves           : %" PRIu64 "\n"
+             "Overwrites      : %" PRIu64 ", %" PRIu64 " of deeper entries\n",
+             t.probes, t.hits, t.hits / p, t.emptyHits, t.emptyHits / p,
+             t.probes - t.hits - t.emptyHits,
+             (t.probes - t.hits - t.emptyHits) / p,
+             t.refreshes, t.saves, t.replaced, t.deeper);
+#ifdef TT_FULLKEYS
+  fprintf(F, "Collisions      : %" PRIu64 " (%.1f per million hits)\n",
+             t.collisions, t.collisions / h);
+#else
+  (void)h;
+#endif
+#endif
+}
+
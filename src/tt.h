@@ -24,18 +24,30 @@
 #include "misc.h"
 #include "types.h"
 
-// TTEntry struct is the 10 bytes transposition table entry, defined as below:
+// TTEntry struct is the transposition table entry, defined as below:
 //
-// key        16 bit
+// key        16 bit (32 bit with TT_BUCKET64)
 // move       16 bit
 // value      16 bit
 // eval value 16 bit
 // generation  6 bit
 // bound type  2 bit
 // depth       8 bit
+//
+// The key field holds the bits of the position key that are not used to
+// find the cluster: the high 16 bits in the default 10-byte entry, or the
+// low 32 bits in the 12-byte entry of the 64-byte bucket layout.
+
+#ifdef TT_BUCKET64
+typedef uint32_t TTKey;
+#define tt_key_bits(k) ((TTKey)(k))
+#else
+typedef uint16_t TTKey;
+#define tt_key_bits(k) ((TTKey)((k) >> 48))
+#endif
 
 struct TTEntry {
-  uint16_t key16;
+  TTKey    key;
   uint16_t move16;
   int16_t  value16;
   int16_t  eval16;
@@ -45,24 +57,123 @@ struct TTEntry {
 
 typedef struct TTEntry TTEntry;
 
-INLINE void tte_save(TTEntry *tte, Key k, Value v, int b, Depth d,
-                            Move m, Value ev, uint8_t g)
+// With TT_LOCKLESS defined, the key is stored XOR-ed with a fold of the
+// entry's move, value, eval, bound and depth fields. A torn write by a
+// concurrent tte_save() then almost certainly yields a key mismatch. As
+// tt_probe() verifies a private copy of the entry and hands that copy to
+// the caller, it never reports a half-written entry as a hit, whatever
+// other threads write to the table afterwards. The generation bits are
+// left out of the fold because tt_probe() refreshes them in place.
+
+#ifdef TT_LOCKLESS
+INLINE TTKey tte_fold(const TTEntry *tte)
+{
+  uint16_t lo = tte->move16 ^ (uint16_t)tte->eval16;
+  uint16_t hi =  (uint16_t)tte->value16
+               ^ (uint16_t)((tte->genBound8 & 0x3) | ((uint8_t)tte->depth8 << 8));
+#ifdef TT_BUCKET64
+  return lo | ((TTKey)hi << 16);
+#else
+  return lo ^ hi;
+#endif
+}
+#else
+#define tte_fold(tte) 0
+#endif
+
+INLINE TTKey tte_key(const TTEntry *tte)
+{
+  return tte->key ^ tte_fold(tte);
+}
+
+// With TT_STATS defined, tt_probe() and tte_save() count their outcomes in
+// the TTStats of the calling thread, which is taken from the Pos in scope
+// as pos. TT_FULLKEYS additionally keeps the full key of every entry in a
+// separate array of the table of pos->engine, so that hits on an entry of
+// another position with the same verification bits can be counted as
+// collisions.
+
+#if defined(TT_FULLKEYS) && !defined(TT_STATS)
+#define TT_STATS
+#endif
+
+struct TTStats {
+  uint64_t probes;
+  uint64_t hits;
+  uint64_t emptyHits;  // Probe ended on an empty entry
+  uint64_t refreshes;  // Hit on an entry of an older search
+  uint64_t saves;
+  uint64_t replaced;   // Save overwrote an entry of another position
+  uint64_t deeper;     // ... that had been searched deeper
+  uint64_t collisions; // Hit on an entry of another position
+};
+
+typedef struct TTStats TTStats;
+
+#ifdef TT_STATS
+#define TT_STATS_ARG , TTStats *stats
+#define tt_stat(x) (stats->x++)
+#define tt_probe(tt, k, f, d) tt_probe_stats(tt, k, f, d, &pos->ttStats)
+#ifdef TT_FULLKEYS
+#define TT_SAVE_ARG , TTStats *stats, Key *fullKey
+#define tte_save(tte, ...) \
+  tte_save_stats(tte, __VA_ARGS__, &pos->ttStats, \
+                 tte_full_key(&pos->engine->tt, tte))
+#else
+#define TT_SAVE_ARG TT_STATS_ARG
+#define tte_save(...) tte_save_stats(__VA_ARGS__, &pos->ttStats)
+#endif
+#else
+#define TT_STATS_ARG
+#define TT_SAVE_ARG
+#define tt_stat(x) ((void)0)
+#define tt_probe_stats tt_probe
+#define tte_save_stats tte_save
+#endif
+
+INLINE void tte_save_stats(TTEntry *tte, Key k, Value v, int b, Depth d,
+                           Move m, Value ev, uint8_t g TT_SAVE_ARG)
 {
+#ifdef TT_LOCKLESS
+  // Work on a private copy and write it back with one struct copy. That is
+  // still several stores, but a reader that sees a mix of the old and the
+  // new entry fails verification.
+  TTEntry e = *tte;
+  TTEntry *dst = tte;
+  tte = &e;
+#endif
+  TTKey key = tte_key(tte);
+
   // Preserve any existing move for the same position
-  if (m || (k >> 48) != tte->key16)
+  if (m || tt_key_bits(k) != key)
     tte->move16 = (uint16_t)m;
 
+  tt_stat(saves);
+  if (tt_key_bits(k) != key && key) {
+    tt_stat(replaced);
+    if (d / ONE_PLY < tte->depth8)
+      tt_stat(deeper);
+  }
+
   // Don't overwrite more valuable entries
-  if (  (k >> 48) != tte->key16
+  if (  tt_key_bits(k) != key
       || d / ONE_PLY > tte->depth8 - 4
    /* || g != (tte->genBound8 & 0xFC) // Matching non-zero keys are already refreshed by probe() */
       || b == BOUND_EXACT) {
-    tte->key16     = (uint16_t)(k >> 48);
+    key            = tt_key_bits(k);
     tte->value16   = (int16_t)v;
     tte->eval16    = (int16_t)ev;
     tte->genBound8 = (uint8_t)(g | b);
     tte->depth8    = (int8_t)(d / ONE_PLY);
+#ifdef TT_FULLKEYS
+    *fullKey = k;
+#endif
   }
+
+  tte->key = key ^ tte_fold(tte);
+#ifdef TT_LOCKLESS
+  *dst = e;
+#endif
 }
 
 INLINE Move tte_move(TTEntry *tte)
@@ -91,19 +202,29 @@ INLINE int tte_bound(TTEntry *tte)
 }
 
 
-// A TranspositionTable consists of a power of 2 number of clusters and
-// each cluster consists of ClusterSize number of TTEntry. Each non-empty
+// A TranspositionTable consists of any number of clusters and each
+// cluster consists of ClusterSize number of TTEntry. Each non-empty
 // entry contains information of exactly one position. The size of a
 // cluster should divide the size of a cache line size, to ensure that
 // clusters never cross cache lines. This ensures best cache performance,
 // as the cacheline is prefetched, as soon as possible.
+//
+// By default two 32-byte clusters of three entries share a cache line.
+// With TT_BUCKET64 a cluster is a whole 64-byte line holding five 12-byte
+// entries, each verified by 32 key bits.
 
 #define CacheLineSize 64
+#ifdef TT_BUCKET64
+#define ClusterSize 5
+#define ClusterPadding 4
+#else
 #define ClusterSize 3
+#define ClusterPadding 2
+#endif
 
 struct Cluster {
   TTEntry entry[ClusterSize];
-  char padding[2]; // Align to a divisor of the cache line size
+  char padding[ClusterPadding]; // Align to a divisor of the cache line size
 };
 
 typedef struct Cluster Cluster;
@@ -113,34 +234,81 @@ struct TranspositionTable {
   Cluster *table;
   void *mem;
   size_t alloc_size;
+  int cleared; // No entry has been written since the table was zeroed
+  int hugePageShift; // 30 or 21 if backed by explicit 1GB or 2MB pages
+  atomic_uchar *sharedGeneration8; // Set if shared with other engines
+  struct TTShmHeader *shmHeader;
+  char shmName[258];
+  Cluster *oldTable; // Table being migrated by tt_resize()
+  size_t oldClusterCount;
+#ifdef TT_FULLKEYS
+  Key *fullKeys;
+#endif
   uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
 };
 
 typedef struct TranspositionTable TranspositionTable;
 
-extern TranspositionTable TT;
+void tt_free(TranspositionTable *tt);
 
-void tt_free(void);
+INLINE void tt_new_search(TranspositionTable *tt)
+{
+  if (tt->sharedGeneration8) // Shared with other engines
+    tt->generation8 = (uint8_t)(atomic_fetch_add(tt->sharedGeneration8, 4) + 4);
+  else
+    tt->generation8 += 4; // Lower 2 bits are used by Bound
+  tt->cleared = 0;
+}
+
+INLINE uint8_t tt_generation(TranspositionTable *tt)
+{
+  return tt->generation8;
+}
 
-INLINE void tt_new_search(void)
+// The cluster index is found by scaling the key bits not stored in the
+// entry, taken as a fraction, to the number of clusters. Unlike masking,
+// this works for any cluster count.
+
+INLINE size_t tt_index(Key key, size_t count)
 {
-  TT.generation8 += 4; // Lower 2 bits are used by Bound
+#ifdef TT_BUCKET64
+#ifdef IS_64BIT
+  return (size_t)(((uint128_t)key * count) >> 64);
+#else
+  return (size_t)(((key >> 32) * count) >> 32);
+#endif
+#else
+#ifdef IS_64BIT
+  return (size_t)(((uint128_t)(key << 16) * count) >> 64);
+#else
+  return (size_t)(((uint64_t)(uint32_t)(key >> 16) * count) >> 32);
+#endif
+#endif
 }
 
-INLINE uint8_t tt_generation(void)
+INLINE TTEntry *tt_first_entry(TranspositionTable *tt, Key key)
 {
-  return TT.generation8;
+  return &tt->table[tt_index(key, tt->clusterCount)].entry[0];
 }
 
-INLINE TTEntry *tt_first_entry(Key key)
+#ifdef TT_FULLKEYS
+INLINE Key *tte_full_key(TranspositionTable *tt, const TTEntry *tte)
 {
-  return &TT.table[(size_t)key & (TT.clusterCount - 1)].entry[0];
+  size_t c = (size_t)((const char *)tte - (const char *)tt->table) / sizeof(Cluster);
+  return &tt->fullKeys[c * ClusterSize + (size_t)(tte - tt->table[c].entry)];
 }
+#endif
 
-TTEntry *tt_probe(Key key, int *found);
-int tt_hashfull(void);
-void tt_allocate(size_t mbSize);
-void tt_clear(void);
+TTEntry *tt_probe_stats(TranspositionTable *tt, Key key, int *found,
+                        TTEntry *data TT_STATS_ARG);
+int tt_hashfull(TranspositionTable *tt);
+void tt_allocate(TranspositionTable *tt, size_t mbSize);
+void tt_resize(Engine *engine, size_t mbSize);
+void tt_clear(Engine *engine);
+int tt_save(TranspositionTable *tt, const char *fname);
+int tt_load(TranspositionTable *tt, const char *fname);
+void tt_print_large_pages(TranspositionTable *tt);
+void tt_print_stats(Engine *engine, FILE *F);
 
 #endif
 
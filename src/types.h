@@ -41,6 +41,21 @@
 // -DUSE_PEXT    | Add runtime support for use of pext asm-instruction.
 //               | Works only in 64-bit mode and requires hardware with
 //               | pext support.
+//
+// -DTT_LOCKLESS | Verify transposition table entries against torn writes
+//               | by concurrent search threads.
+//
+// -DTT_BUCKET64 | Use 64-byte transposition table clusters of five entries
+//               | with 32 verification bits each.
+//
+// -DTT_STATS    | Count transposition table probes, hits and replacements
+//               | per thread, see the "stats" command.
+//
+// -DTT_FULLKEYS | Like TT_STATS, but also keep the full key of each entry
+//               | to count hits on entries of other positions.
+//
+// -DUSE_FUTEX   | Park idle threads by spinning for up to "Spin Wait"
+//               | microseconds and then sleeping on a futex (Linux only).
 
 #ifndef NDEBUG
 #include <assert.h>
@@ -109,6 +124,10 @@
 typedef uint64_t Key;
 typedef uint64_t Bitboard;
 
+#ifdef IS_64BIT
+__extension__ typedef unsigned __int128 uint128_t;
+#endif
+
 #define MAX_MOVES 256
 #define MAX_PLY 128
 
@@ -387,6 +406,10 @@ extern uint32_t NonPawnPieceValue[16];
 #define make_castling(from,to) ((Move)((to) | ((from)<<6) | (CASTLING<<14)))
 #define move_is_ok(m) (from_sq(m) != to_sq(m))
 
+// make_key() spreads a small value over all bits of a Key, so that keys
+// derived from a position key do not share its transposition table slot.
+#define make_key(v) ((Key)(v) * 6364136223846793005ULL + 1442695040888963407ULL)
+
 INLINE int opposite_colors(Square s1, Square s2)
 {
   int s = (int)(s1) ^ (int)(s2);
@@ -394,8 +417,10 @@ INLINE int opposite_colors(Square s1, Square s2)
 }
 
 typedef struct Pos Pos;
+typedef struct Engine Engine;
 typedef struct LimitsType LimitsType;
 typedef struct RootMoves RootMoves;
+typedef struct SplitPoint SplitPoint;
 typedef struct PawnEntry PawnEntry;
 typedef struct MaterialEntry MaterialEntry;
 
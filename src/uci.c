@@ -19,10 +19,13 @@
 */
 
 #define _GNU_SOURCE
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 
+#include "cluster.h"
+#include "engine.h"
 #include "evaluate.h"
 #include "misc.h"
 #include "movegen.h"
@@ -31,9 +34,16 @@
 #include "settings.h"
 #include "thread.h"
 #include "timeman.h"
+#include "tt.h"
 #include "uci.h"
 
 extern void benchmark(Pos *pos, char *str);
+extern void analyse(Pos *pos, char *str);
+extern void scaling(Pos *pos, char *str);
+extern void ttd(Pos *pos, char *str);
+extern void castling(Pos *pos, char *str);
+
+Engine *UciEngine; // The engine driven by the UCI commands
 
 // FEN string of the initial position, normal chess
 const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
@@ -43,7 +53,7 @@ const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1
 // string ("fen") or the starting position ("startpos") and then makes
 // the moves given in the following move list ("moves").
 
-void position(Pos *pos, char *str)
+void position(Engine *engine, char *str)
 {
   char fen[128];
   char *moves;
@@ -62,17 +72,13 @@ void position(Pos *pos, char *str)
   else
     return;
 
-  pos_set(pos, fen, option_value(OPT_CHESS960));
+  engine_set_fen(engine, fen, option_value(OPT_CHESS960));
 
   // Parse move list (if any)
   if (moves)
-    for (moves = strtok(moves, " \t"); moves; moves = strtok(NULL, " \t")) {
-      Move m = uci_to_move(pos, moves);
-      if (!m) break;
-      pos->st->endMoves = (pos->st-1)->endMoves;
-      do_move(pos, m, gives_check(pos, pos->st, m));
-      pos->gamePly++;
-    }
+    for (moves = strtok(moves, " \t"); moves; moves = strtok(NULL, " \t"))
+      if (engine_do_move(engine, uci_to_move(&engine->root, moves)))
+        break;
 }
 
 
@@ -107,8 +113,13 @@ void setoption(char *str)
   if (!value || strlen(value) == 0)
     value = "<empty>";
 
-  if (option_set_by_name(name, value))
+  // Let a change of Hash, Threads, NUMA or LargePages take effect in the
+  // background, but never while an earlier change is still being applied.
+  wait_for_delayed_settings();
+  if (option_set_by_name(name, value)) {
+    process_delayed_settings_async();
     return;
+  }
 
 error:
   fprintf(stderr, "No such option: %s\n", name);
@@ -117,13 +128,15 @@ error:
 
 // go() is called when engine receives the "go" UCI command. The function sets
 // the thinking time and other parameters from the input string, then starts
-// the search.
+// the search. Pending changes of Hash, Threads, etc. have normally been
+// applied in the background already.
 
-void go(Pos *pos, char *str)
+void go(Engine *engine, char *str)
 {
   LimitsType limits;
   char *token;
 
+  engine_wait(engine);
   process_delayed_settings();
 
   limits.startTime = now(); // As early as possible!
@@ -136,7 +149,7 @@ void go(Pos *pos, char *str)
   for (token = strtok(str, " \t"); token; token = strtok(NULL, " \t")) {
     if (strcmp(token, "searchmoves") == 0)
       while ((token = strtok(NULL, " \t")))
-        limits.searchmoves[limits.num_searchmoves++] = uci_to_move(pos, token);
+        limits.searchmoves[limits.num_searchmoves++] = uci_to_move(&engine->root, token);
     else if (strcmp(token, "wtime") == 0)
       limits.time[WHITE] = atoi(strtok(NULL, " \t"));
     else if (strcmp(token, "btime") == 0)
@@ -161,7 +174,75 @@ void go(Pos *pos, char *str)
       limits.ponder = 1;
   }
 
-  threads_start_thinking(pos, &limits);
+  engine_go(engine, &limits);
+}
+
+
+// The UCI callbacks print the search output of the engine in data as
+// "info" and "bestmove" lines.
+
+static void uci_on_pv(void *data, const SearchInfo *info)
+{
+  int chess960 = ((Engine *)data)->root.chess960;
+  char buf[32];
+
+  IO_LOCK;
+  printf("info depth %d", info->depth);
+  if (info->depth == 0) { // No legal moves
+    printf(" score %s\n", uci_value(buf, info->score));
+    fflush(stdout);
+    IO_UNLOCK;
+    return;
+  }
+
+  printf(" seldepth %d multipv %d score %s", info->selDepth, info->multiPV,
+         uci_value(buf, info->score));
+  printf("%s",  info->bound == BOUND_LOWER ? " lowerbound"
+              : info->bound == BOUND_UPPER ? " upperbound" : "");
+  printf(" nodes %"PRIu64" nps %"PRIu64, info->nodes, info->nps);
+  if (info->hashfull >= 0)
+    printf(" hashfull %d", info->hashfull);
+  printf(" tbhits %"PRIu64" time %d pv", info->tbHits, info->time);
+  for (size_t idx = 0; idx < info->pvSize; idx++)
+    printf(" %s", uci_move(buf, info->pv[idx], chess960));
+  printf("\n");
+  fflush(stdout);
+  IO_UNLOCK;
+}
+
+static void uci_on_currmove(void *data, int depth, Move move, int number)
+{
+  char buf[16];
+
+  IO_LOCK;
+  printf("info depth %d currmove %s currmovenumber %d\n", depth,
+         uci_move(buf, move, ((Engine *)data)->root.chess960), number);
+  fflush(stdout);
+  IO_UNLOCK;
+}
+
+static void uci_on_nodes(void *data, uint64_t nodes, int time)
+{
+  (void)data;
+
+  IO_LOCK;
+  printf("info nodes %"PRIu64" time %d\n", nodes, time);
+  fflush(stdout);
+  IO_UNLOCK;
+}
+
+static void uci_on_bestmove(void *data, Move best, Move ponder)
+{
+  int chess960 = ((Engine *)data)->root.chess960;
+  char buf[16];
+
+  IO_LOCK;
+  printf("bestmove %s", uci_move(buf, best, chess960));
+  if (ponder)
+    printf(" ponder %s", uci_move(buf, ponder, chess960));
+  printf("\n");
+  fflush(stdout);
+  IO_UNLOCK;
 }
 
 
@@ -174,29 +255,13 @@ void go(Pos *pos, char *str)
 
 void uci_loop(int argc, char **argv)
 {
-  Pos pos;
-  char fen[strlen(StartFEN) + 1];
+  Engine *engine = UciEngine;
+  Pos *pos = &engine->root;
   char *token;
 
-  LOCK_INIT(Signals.lock);
-
-  // Signals.searching is only read and set by the UI thread.
-  // The UI thread uses it to know whether it must still call
-  // thread_wait_for_search_finished() on the main search thread.
-  // (This is important for our native Windows threading implementation.)
-  Signals.searching = 0;
-
-  // Signals.sleeping is set by the main search thread if it has run
-  // out of work but must wait for a "stop" or "ponderhit" command from
-  // the GUI to arrive before being allowed to output "bestmove". The main
-  // thread will then go to sleep and has to be waken up by the UI thread.
-  // This variable must be accessed only after acquiring Signals.lock.
-  Signals.sleeping = 0;
-
-  pos.stack = malloc(1000 * sizeof(Stack));
-  pos.stack++;
-  pos.moveList = malloc(1000 * sizeof(ExtMove));
-  pos.stack[-1].endMoves = pos.moveList;
+  EngineCallbacks cb = { uci_on_pv, uci_on_currmove, uci_on_nodes,
+                         uci_on_bestmove, engine };
+  engine_set_callbacks(engine, &cb);
 
   size_t buf_size = 1;
   for (int i = 1; i < argc; i++)
@@ -212,9 +277,6 @@ void uci_loop(int argc, char **argv)
     strcat(cmd, " ");
   }
 
-  strcpy(fen, StartFEN);
-  pos_set(&pos, fen, 0);
-
   do {
     if (argc == 1 && !getline(&cmd, &buf_size, stdin))
       strcpy(cmd, "quit");
@@ -237,33 +299,16 @@ void uci_loop(int argc, char **argv)
     }
 
     // The GUI sends 'ponderhit' to tell us to ponder on the same move the
-    // opponent has played. In case Signals.stopOnPonderhit is set we are
+    // opponent has played. In case signals.stopOnPonderhit is set we are
     // waiting for 'ponderhit' to stop the search (for instance because we
     // already ran out of time), otherwise we should continue searching but
     // switching from pondering to normal search.
     if (   strcmp(token, "quit") == 0
         || strcmp(token, "stop") == 0) {
-      if (Signals.searching) {
-        Signals.stop = 1;
-        LOCK(Signals.lock);
-        if (Signals.sleeping)
-          thread_start_searching(threads_main(), 1); // Wake up main thread.
-        Signals.sleeping = 0;
-        UNLOCK(Signals.lock);
-      }
-    }
-    else if (strcmp(token, "ponderhit") == 0) {
-      Limits.ponder = 0; // Switch to normal search
-      if (Signals.stopOnPonderhit)
-        Signals.stop = 1;
-      LOCK(Signals.lock);
-      if (Signals.sleeping) {
-        Signals.stop = 1;
-        thread_start_searching(threads_main(), 1); // Wake up main thread.
-        Signals.sleeping = 0;
-      }
-      UNLOCK(Signals.lock);
+      engine_stop(engine);
     }
+    else if (strcmp(token, "ponderhit") == 0)
+      engine_ponderhit(engine);
     else if (strcmp(token, "uci") == 0) {
       printf("id name ");
       print_engine_info(1);
@@ -273,27 +318,38 @@ void uci_loop(int argc, char **argv)
       fflush(stdout);
     }
     else if (strcmp(token, "ucinewgame") == 0) {
-      search_clear();
-      Time.availableNodes = 0;
+      process_delayed_settings();
+      engine_new_game(engine);
     }
     else if (strcmp(token, "isready") == 0) {
       process_delayed_settings();
       printf("readyok\n");
       fflush(stdout);
     }
-    else if (strcmp(token, "go") == 0)        go(&pos, str);
-    else if (strcmp(token, "position") == 0)  position(&pos, str);
+    else if (strcmp(token, "go") == 0)        go(engine, str);
+    else if (strcmp(token, "position") == 0)  position(engine, str);
     else if (strcmp(token, "setoption") == 0) setoption(str);
 
     // Additional custom non-UCI commands, useful for debugging
-    else if (strcmp(token, "bench") == 0)     benchmark(&pos, str);
-    else if (strcmp(token, "d") == 0)         print_pos(&pos);
+    else if (strcmp(token, "bench") == 0)     benchmark(pos, str);
+    else if (strcmp(token, "analyse") == 0)   analyse(pos, str);
+    else if (strcmp(token, "scaling") == 0)   scaling(pos, str);
+    else if (strcmp(token, "ttd") == 0)       ttd(pos, str);
+    else if (strcmp(token, "castling") == 0)  castling(pos, str);
+    else if (strcmp(token, "worker") == 0)    cluster_worker(engine, str);
+    else if (strcmp(token, "d") == 0)         print_pos(pos);
+    else if (strcmp(token, "stats") == 0) {
+      wait_for_delayed_settings();
+      tt_print_stats(engine, stdout);
+      search_print_latency(engine, stdout);
+      fflush(stdout);
+    }
 //    else if (strcmp(token, "eval") == 0)      eval_trace(stdout, &pos);
     else if (strcmp(token, "perft") == 0) {
       char str2[64];
       sprintf(str2, "%d %d %d current perft", option_value(OPT_HASH),
                     option_value(OPT_THREADS), atoi(str));
-      benchmark(&pos, str2);
+      benchmark(pos, str2);
     }
     else {
       printf("Unknown command: %s %s\n", token, str);
@@ -301,14 +357,10 @@ void uci_loop(int argc, char **argv)
     }
   } while (argc == 1 && strcmp(token, "quit") != 0);
 
-  if (Signals.searching)
-    thread_wait_for_search_finished(threads_main());
+  engine_wait(engine);
+  wait_for_delayed_settings();
 
   free(cmd);
-  free(pos.stack - 1);
-  free(pos.moveList);
-
-  LOCK_DESTROY(Signals.lock);
 }
 
 
@@ -30,12 +30,14 @@ typedef struct Option Option;
 
 typedef void (*OnChange)(Option *);
 
-// no options are of type combo
+// The value of a combo option is the index of its setting in def_string,
+// which lists the settings separated by " var ".
 #define OPT_TYPE_CHECK    0
 #define OPT_TYPE_SPIN     1
 #define OPT_TYPE_BUTTON   2
 #define OPT_TYPE_STRING   3
-#define OPT_TYPE_DISABLED 4
+#define OPT_TYPE_COMBO    4
+#define OPT_TYPE_DISABLED 5
 
 #define OPT_DEBUG_LOG_FILE  0
 #define OPT_CONTEMPT        1
@@ -56,6 +58,19 @@ typedef void (*OnChange)(Option *);
 #define OPT_SYZ_PROBE_LIMIT 16
 #define OPT_LARGE_PAGES     17
 #define OPT_NUMA            18
+#define OPT_HASH_FILE       19
+#define OPT_SAVE_HASH       20
+#define OPT_LOAD_HASH       21
+#define OPT_SHARED_HASH     22
+#define OPT_SPIN_WAIT       23
+#define OPT_BIND_THREADS    24
+#define OPT_HISTORY_PER_L3  25
+#define OPT_MULTIPV_SPLIT   26
+#define OPT_HELPER_SCHEDULE 27
+#define OPT_SMP_MODE        28
+#define OPT_MIN_SPLIT_DEPTH 29
+#define OPT_CLUSTER_SOCKET  30
+#define OPT_CLUSTER_WORKERS 31
 
 struct Option {
   char *name;
@@ -75,6 +90,9 @@ char *option_string_value(int opt);
 void option_set_value(int opt, int value);
 int option_set_by_name(char *name, char *value);
 
+extern Engine *UciEngine;
+extern const char *StartFEN;
+
 void uci_loop(int argc, char* argv[]);
 char *uci_value(char *str, Value v);
 char *uci_square(char *str, Square s);
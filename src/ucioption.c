@@ -28,12 +28,15 @@
 #include <sys/mman.h>
 #endif
 
+#include "cluster.h"
+#include "engine.h"
 #include "misc.h"
 #include "numa.h"
 #include "search.h"
 #include "settings.h"
 #include "tbprobe.h"
 #include "thread.h"
+#include "topology.h"
 #include "tt.h"
 #include "uci.h"
 
@@ -43,7 +46,45 @@ static void on_clear_hash(Option *opt)
   (void)opt;
 
   if (settings.tt_size)
-    search_clear();
+    search_clear(UciEngine);
+}
+
+static void on_save_hash(Option *opt)
+{
+  (void)opt;
+
+  char *fname = option_string_value(OPT_HASH_FILE);
+  if (!settings.tt_size || strcmp(fname, "<empty>") == 0)
+    return;
+
+  if (tt_save(&UciEngine->tt, fname))
+    printf("info string Unable to save hash to %s.\n", fname);
+  else
+    printf("info string Hash saved to %s.\n", fname);
+  fflush(stdout);
+}
+
+static void on_load_hash(Option *opt)
+{
+  (void)opt;
+
+  char *fname = option_string_value(OPT_HASH_FILE);
+  if (strcmp(fname, "<empty>") == 0)
+    return;
+
+  // Apply pending settings first, so that they do not throw away the
+  // loaded table later on.
+  process_delayed_settings();
+
+  if (tt_load(&UciEngine->tt, fname))
+    printf("info string Unable to load hash from %s.\n", fname);
+  else {
+    size_t mbSize = (UciEngine->tt.clusterCount * sizeof(Cluster)) >> 20;
+    settings.tt_size = delayed_settings.tt_size = max(mbSize, 1);
+    printf("info string Hash of %" FMT_Z "uMB loaded from %s.\n",
+           settings.tt_size, fname);
+  }
+  fflush(stdout);
 }
 
 static void on_hash_size(Option *opt)
@@ -51,6 +92,15 @@ static void on_hash_size(Option *opt)
   delayed_settings.tt_size = opt->value;
 }
 
+static void on_shared_hash(Option *opt)
+{
+  if (strcmp(opt->val_string, "<empty>") == 0)
+    delayed_settings.shm_name[0] = 0;
+  else
+    strncpy(delayed_settings.shm_name, opt->val_string,
+            sizeof(delayed_settings.shm_name) - 1);
+}
+
 static void on_logger(Option *opt)
 {
   start_logger(opt->val_string);
@@ -73,21 +123,62 @@ static void on_tb_path(Option *opt)
   TB_init(opt->val_string);
 }
 
+static void on_bind_threads(Option *opt)
+{
+  delayed_settings.bind_threads = opt->value;
+}
+
+static void on_history_per_l3(Option *opt)
+{
+  delayed_settings.history_per_l3 = opt->value;
+}
+
 static void on_largepages(Option *opt)
 {
   delayed_settings.large_pages = opt->value;
 }
 
+// The cluster is set up again when either of its options changes. At
+// startup there is no cluster to set up.
+
+static void on_cluster(Option *opt)
+{
+  (void)opt;
+
+  if (UciEngine)
+    cluster_setup(UciEngine, option_string_value(OPT_CLUSTER_SOCKET),
+                  option_value(OPT_CLUSTER_WORKERS));
+}
+
 #ifdef IS_64BIT
 #define MAXHASHMB (1024 * 1024)
 #else
 #define MAXHASHMB 2048
 #endif
 
+// auto_value() returns the value that "auto" stands for, or 0 if the
+// option does not take it. Threads becomes the number of threads that can
+// run without being throttled by our cpu affinity or cgroup quota, and
+// Hash half of the memory we may use, in MB. The table takes any number of
+// clusters, so the size is not rounded to a power of two.
+
+static int auto_value(int opt_idx)
+{
+  if (opt_idx == OPT_THREADS)
+    return max(1, min(topology_cpu_limit(), MAX_THREADS));
+
+  if (opt_idx == OPT_HASH) {
+    uint64_t mb = topology_memory_limit() >> 21;
+    return mb ? (int)min(mb, (uint64_t)MAXHASHMB) : 16;
+  }
+
+  return 0;
+}
+
 static Option options_map[] = {
   { "Debug Log File", OPT_TYPE_STRING, 0, 0, 0, "<empty>", on_logger, 0, NULL },
   { "Contempt", OPT_TYPE_SPIN, 0, -100, 100, NULL, NULL, 0, NULL },
-  { "Threads", OPT_TYPE_SPIN, 1, 1, 128, NULL, on_threads, 0, NULL },
+  { "Threads", OPT_TYPE_SPIN, 1, 1, MAX_THREADS, NULL, on_threads, 0, NULL },
   { "Hash", OPT_TYPE_SPIN, 16, 1, MAXHASHMB, NULL, on_hash_size, 0, NULL },
   { "Clear Hash", OPT_TYPE_BUTTON, 0, 0, 0, NULL, on_clear_hash, 0, NULL },
   { "Ponder", OPT_TYPE_CHECK, 0, 0, 0, NULL, NULL, 0, NULL },
@@ -104,6 +195,19 @@ static Option options_map[] = {
   { "SyzygyProbeLimit", OPT_TYPE_SPIN, 6, 0, 6, NULL, NULL, 0, NULL },
   { "LargePages", OPT_TYPE_CHECK, 1, 0, 0, NULL, on_largepages, 0, NULL },
   { "NUMA", OPT_TYPE_STRING, 0, 0, 0, "all", on_numa, 0, NULL },
+  { "Hash File", OPT_TYPE_STRING, 0, 0, 0, "<empty>", NULL, 0, NULL },
+  { "Save Hash", OPT_TYPE_BUTTON, 0, 0, 0, NULL, on_save_hash, 0, NULL },
+  { "Load Hash", OPT_TYPE_BUTTON, 0, 0, 0, NULL, on_load_hash, 0, NULL },
+  { "Shared Hash", OPT_TYPE_STRING, 0, 0, 0, "<empty>", on_shared_hash, 0, NULL },
+  { "Spin Wait", OPT_TYPE_SPIN, 0, 0, 10000, NULL, NULL, 0, NULL },
+  { "Bind Threads", OPT_TYPE_CHECK, 0, 0, 0, NULL, on_bind_threads, 0, NULL },
+  { "History per L3", OPT_TYPE_CHECK, 0, 0, 0, NULL, on_history_per_l3, 0, NULL },
+  { "MultiPV Split", OPT_TYPE_CHECK, 0, 0, 0, NULL, NULL, 0, NULL },
+  { "Helper Schedule", OPT_TYPE_COMBO, 0, 0, 0, "Matrix var Offset var Partition", NULL, 0, NULL },
+  { "SMP Mode", OPT_TYPE_COMBO, 0, 0, 0, "Lazy var YBWC", NULL, 0, NULL },
+  { "Min Split Depth", OPT_TYPE_SPIN, 5, 2, 32, NULL, NULL, 0, NULL },
+  { "Cluster Socket", OPT_TYPE_STRING, 0, 0, 0, "<empty>", on_cluster, 0, NULL },
+  { "Cluster Workers", OPT_TYPE_SPIN, 0, 0, CLUSTER_MAX_WORKERS, NULL, on_cluster, 0, NULL },
   { NULL }
 };
 
@@ -124,11 +228,23 @@ void options_init()
   // Disable the LargePages option if the machine does not support it.
   if (!large_pages_supported())
     options_map[OPT_LARGE_PAGES].type = OPT_TYPE_DISABLED;
+  options_map[OPT_SHARED_HASH].type = OPT_TYPE_DISABLED;
+  options_map[OPT_CLUSTER_SOCKET].type = OPT_TYPE_DISABLED;
+  options_map[OPT_CLUSTER_WORKERS].type = OPT_TYPE_DISABLED;
+#endif
+#ifndef __linux__
+  // Threads are bound to cpus of the topology read from sysfs.
+  options_map[OPT_BIND_THREADS].type = OPT_TYPE_DISABLED;
+  options_map[OPT_HISTORY_PER_L3].type = OPT_TYPE_DISABLED;
 #endif
 #ifdef __linux__
 #ifndef MADV_HUGEPAGE
   options_map[OPT_LARGE_PAGES].type = OPT_TYPE_DISABLED;
 #endif
+#endif
+#ifndef USE_FUTEX
+  // Only the futex wake-up spins before sleeping.
+  options_map[OPT_SPIN_WAIT].type = OPT_TYPE_DISABLED;
 #endif
   for (Option *opt = options_map; opt->name != NULL; opt++) {
     if (opt->type == OPT_TYPE_DISABLED)
@@ -136,6 +252,7 @@ void options_init()
     switch (opt->type) {
     case OPT_TYPE_CHECK:
     case OPT_TYPE_SPIN:
+    case OPT_TYPE_COMBO:
       opt->value = opt->def;
     case OPT_TYPE_BUTTON:
       break;
@@ -158,14 +275,35 @@ void options_free(void)
 
 static char *opt_type_str[] =
 {
-  "check", "spin", "button", "string"
+  "check", "spin", "button", "string", "combo"
 };
 
+// combo_var() copies setting number idx of a combo option into buf and
+// returns 0 if there is no such setting.
+
+static int combo_var(Option *opt, int idx, char *buf, size_t size)
+{
+  const char *s = opt->def_string;
+  for (; idx > 0; idx--) {
+    if (!(s = strstr(s, " var ")))
+      return 0;
+    s += 5;
+  }
+  size_t len = strcspn(s, " ");
+  if (len >= size)
+    return 0;
+  memcpy(buf, s, len);
+  buf[len] = 0;
+  return 1;
+}
+
 // print_options() priints all options in the format required by the
 // UCI protocol.
 
 void print_options(void)
 {
+  char buf[64];
+
   for (Option *opt = options_map; opt->name != NULL; opt++) {
     if (opt->type == OPT_TYPE_DISABLED)
       continue;
@@ -181,6 +319,10 @@ void print_options(void)
     case OPT_TYPE_STRING:
       printf(" default %s", opt->def_string);
       break;
+    case OPT_TYPE_COMBO:
+      combo_var(opt, opt->def, buf, sizeof(buf));
+      printf(" default %s var %s", buf, opt->def_string);
+      break;
     }
     printf("\n");
   }
@@ -208,6 +350,8 @@ void option_set_value(int opt_idx, int value)
 
 int option_set_by_name(char *name, char *value)
 {
+  char buf[64];
+
   for (Option *opt = options_map; opt->name != NULL; opt++) {
     if (opt->type == OPT_TYPE_DISABLED)
       continue;
@@ -223,7 +367,12 @@ int option_set_by_name(char *name, char *value)
           return 1;
         break;
       case OPT_TYPE_SPIN:
-        val = atoi(value);
+        if (   strcasecmp(value, "auto") == 0
+            && (val = auto_value(opt - options_map))) {
+          printf("info string %s set to %d.\n", opt->name, val);
+          fflush(stdout);
+        } else
+          val = atoi(value);
         if (val < opt->min_val || val > opt->max_val)
           return 1;
         opt->value = val;
@@ -234,6 +383,14 @@ int option_set_by_name(char *name, char *value)
         opt->val_string = malloc(strlen(value) + 1);
         strcpy(opt->val_string, value);
         break;
+      case OPT_TYPE_COMBO:
+        for (val = 0; combo_var(opt, val, buf, sizeof(buf)); val++)
+          if (strcasecmp(buf, value) == 0)
+            break;
+        if (!combo_var(opt, val, buf, sizeof(buf)))
+          return 1;
+        opt->value = val;
+        break;
       }
       if (opt->on_change)
         opt->on_change(opt);